@@ -0,0 +1,199 @@
+#include <iostream>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <cstring>
+#include <cstdint>
+#include <sys/resource.h>
+#include "huffman.hpp"
+#include "rans.hpp"
+
+// Throughput of the huffman engine per phase, printed as JSON:
+//   bench [--quick]
+// Every phase is repeated until it has run for MIN_PHASE_SECONDS and the fastest run is reported.
+// Histogram, tree build, encode and decode are timed apart; encode and decode use the table
+// already built. compress and unpack time the whole message path, table included, on top.
+
+static double const MIN_PHASE_SECONDS = 0.2;
+
+static size_t const MIN_PHASE_RUNS = 3;
+
+static size_t const SIZES[] = { 4 << 10, 64 << 10, 1 << 20, 16 << 20 };
+
+static size_t const QUICK_SIZES[] = { 4 << 10, 256 << 10 };
+
+static char const * const WORDS[] = { "the", "of", "and", "request", "GET", "POST", "status", "200", "404",
+    "host", "user", "session", "latency_ms", "error", "timeout", "cache", "miss", "hit", "/api/v1/items",
+    "INFO", "WARN", "DEBUG", "2026-10-19T12:00:00Z", "id", "=", ":", "," };
+
+    static std::vector<uint8_t> makeCorpus(const std::string& name, size_t size)
+    {
+        std::mt19937_64 random(size);
+        std::vector<uint8_t> data(size);
+        if (name == "random")
+        {
+            for (size_t i = 0; i != size; ++i)
+                data[i] = (uint8_t)random();
+        }
+        else if (name == "skewed")
+        {
+            std::geometric_distribution<int> distribution(0.3);
+            for (size_t i = 0; i != size; ++i)
+                data[i] = (uint8_t)distribution(random);
+        }
+        else if (name == "text")
+        {
+            size_t const wordCount = sizeof(WORDS) / sizeof(WORDS[0]);
+            size_t position = 0;
+            while (position != size)
+            {
+                const char* word = WORDS[random() % wordCount];
+                for (; *word != '\0' && position != size; ++word)
+                    data[position++] = *word;
+                if (position != size)
+                    data[position++] = (random() % 12 == 0) ? '\n' : ' ';
+            }
+        }
+        else
+        {
+            // little-endian records of small counters and flags, like typical binary telemetry
+            for (size_t i = 0; i != size; ++i)
+            {
+                switch (i % 8)
+                {
+                case 0: data[i] = (uint8_t)(random() % 64); break;
+                case 1: data[i] = (uint8_t)(random() % 4); break;
+                case 4: data[i] = (uint8_t)(random() % 2); break;
+                default: data[i] = 0; break;
+                }
+            }
+        }
+        return data;
+    }
+
+    template <class Phase>
+    static double fastestSeconds(Phase phase)
+    {
+        double best = 1e30;
+        double total = 0;
+        for (size_t runs = 0; runs < MIN_PHASE_RUNS || total < MIN_PHASE_SECONDS; ++runs)
+        {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            phase();
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            best = std::min(best, seconds);
+            total += seconds;
+        }
+        return best;
+    }
+
+    static double megabytesPerSecond(size_t size, double seconds)
+    {
+        return size / seconds / (1 << 20);
+    }
+
+    static void runCorpus(const std::string& name, size_t size, bool isFirst)
+    {
+        std::vector<uint8_t> data = makeCorpus(name, size);
+        std::vector<uint8_t> compressed(HuffmanCode::compressBound(size));
+        std::vector<uint8_t> decompressed(size);
+        HuffmanCode coder;
+
+        uint64_t frequency[256];
+        double histogramSeconds = fastestSeconds([&]() {
+            memset(frequency, 0, sizeof(frequency));
+            HuffmanCode::countFrequency(data.data(), size, frequency);
+        });
+        // independent of the input size, so reported in microseconds only
+        double treeSeconds = fastestSeconds([&]() {
+            coder.buildCodeTable(frequency);
+        });
+
+        size_t encodedSize = 0;
+        double encodeSeconds = fastestSeconds([&]() {
+            encodedSize = coder.encode(data.data(), size, compressed.data(), compressed.size());
+        });
+        double decodeSeconds = fastestSeconds([&]() {
+            coder.decode(compressed.data(), encodedSize, decompressed.data(), size);
+        });
+        if (decompressed != data)
+            throw HuffmanCode::HuffmanCodeException("Round trip failed");
+
+        size_t compressedSize = 0;
+        double compressSeconds = fastestSeconds([&]() {
+            compressedSize = coder.compress(data.data(), size, compressed.data(), compressed.size());
+        });
+        double unpackSeconds = fastestSeconds([&]() {
+            coder.unpack(compressed.data(), compressedSize, decompressed.data(), size);
+        });
+        if (decompressed != data)
+            throw HuffmanCode::HuffmanCodeException("Round trip failed");
+
+        RansCoder rans;
+        rans.normalize(frequency);
+        std::vector<uint8_t> ransBuffer(RansCoder::encodeBound(size));
+        size_t ransStart = 0;
+        double ansEncodeSeconds = fastestSeconds([&]() {
+            ransStart = rans.encode(data.data(), size, ransBuffer.data(), ransBuffer.size());
+        });
+        double ansDecodeSeconds = fastestSeconds([&]() {
+            rans.decode(ransBuffer.data() + ransStart, ransBuffer.size() - ransStart, decompressed.data(), size);
+        });
+        if (decompressed != data)
+            throw HuffmanCode::HuffmanCodeException("ANS round trip failed");
+
+        std::cout << (isFirst ? "" : ",\n") << "    {\"corpus\": \"" << name << "\", \"size\": " << size
+            << ", \"histogram_mb_s\": " << megabytesPerSecond(size, histogramSeconds)
+            << ", \"tree_build_us\": " << treeSeconds * 1e6
+            << ", \"encode_mb_s\": " << megabytesPerSecond(size, encodeSeconds)
+            << ", \"decode_mb_s\": " << megabytesPerSecond(size, decodeSeconds)
+            << ", \"compress_mb_s\": " << megabytesPerSecond(size, compressSeconds)
+            << ", \"unpack_mb_s\": " << megabytesPerSecond(size, unpackSeconds)
+            << ", \"ans_encode_mb_s\": " << megabytesPerSecond(size, ansEncodeSeconds)
+            << ", \"ans_decode_mb_s\": " << megabytesPerSecond(size, ansDecodeSeconds)
+            << ", \"ans_size\": " << ransBuffer.size() - ransStart
+            << ", \"compressed_size\": " << compressedSize
+            << ", \"ratio\": " << (double)compressedSize / size << "}";
+    }
+
+int main(int argc, char* argv[])
+{
+    std::ios_base::sync_with_stdio(0);
+    try
+    {
+        bool isQuick = (argc == 2 && std::string(argv[1]) == "--quick");
+        if (argc > 2 || (argc == 2 && !isQuick))
+        {
+            throw HuffmanCode::HuffmanCodeException("Usage: bench [--quick]");
+        }
+
+        std::vector<size_t> sizes;
+        if (isQuick)
+            sizes.assign(QUICK_SIZES, QUICK_SIZES + sizeof(QUICK_SIZES) / sizeof(QUICK_SIZES[0]));
+        else
+            sizes.assign(SIZES, SIZES + sizeof(SIZES) / sizeof(SIZES[0]));
+
+        char const * const corpora[] = { "random", "skewed", "text", "binary" };
+        std::cout << "{\n  \"benchmark\": \"huffman\",\n  \"results\": [\n";
+        bool isFirst = true;
+        for (size_t i = 0; i != sizeof(corpora) / sizeof(corpora[0]); ++i)
+        {
+            for (size_t j = 0; j != sizes.size(); ++j)
+            {
+                runCorpus(corpora[i], sizes[j], isFirst);
+                isFirst = false;
+            }
+        }
+
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        std::cout << "\n  ],\n  \"peak_rss_kb\": " << usage.ru_maxrss << "\n}\n";
+    } catch (const HuffmanCode::HuffmanCodeException &currentHuffmanCodeException)
+    {
+        std::cerr << "HuffmanCodeException: " << currentHuffmanCodeException.what();
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,103 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+template <class Sink>
+class BitWriter
+{
+public:
+    explicit BitWriter(Sink& sink)
+        :m_sink(sink)
+        ,m_accumulator(0)
+        ,m_bitCount(0)
+    {    }
+
+    // Appends the low `length` bits of `code`, most significant first; length is 1..64.
+    void write(std::uint64_t code, unsigned length)
+    {
+        if (length > 32)
+        {
+            put((std::uint32_t)(code >> 32), length - 32);
+            length = 32;
+        }
+        put((std::uint32_t)code, length);
+    }
+
+    // Pads the last byte with zero bits.
+    void flush()
+    {
+        if (m_bitCount != 0)
+        {
+            m_sink.put((std::uint8_t)(m_accumulator << (8 - m_bitCount)));
+            m_bitCount = 0;
+        }
+    }
+
+private:
+    Sink& m_sink;
+    std::uint64_t m_accumulator;
+    unsigned m_bitCount;
+
+    void put(std::uint32_t code, unsigned length)
+    {
+        if (length < 32)
+            code &= (std::uint32_t(1) << length) - 1;
+        m_accumulator = (m_accumulator << length) | code;
+        m_bitCount += length;
+        while (m_bitCount >= 8)
+        {
+            m_bitCount -= 8;
+            m_sink.put((std::uint8_t)(m_accumulator >> m_bitCount));
+        }
+    }
+};
+
+class BitReader
+{
+public:
+    BitReader(const std::uint8_t* data, std::uint64_t bitCount)
+        :m_data(data)
+        ,m_byteCount(bitCount / 8 + (bitCount % 8 != 0))
+        ,m_position(0)
+    {    }
+
+    // Returns the next `length` bits (1..57) without consuming them; bits past the end read as zero.
+    std::uint64_t peek(unsigned length) const
+    {
+        std::uint64_t byteIndex = m_position / 8;
+        std::uint64_t window = 0;
+        if (byteIndex + 8 <= m_byteCount)
+        {
+            const std::uint8_t* bytes = m_data + byteIndex;
+            window = ((std::uint64_t)bytes[0] << 56) | ((std::uint64_t)bytes[1] << 48)
+                | ((std::uint64_t)bytes[2] << 40) | ((std::uint64_t)bytes[3] << 32)
+                | ((std::uint64_t)bytes[4] << 24) | ((std::uint64_t)bytes[5] << 16)
+                | ((std::uint64_t)bytes[6] << 8) | (std::uint64_t)bytes[7];
+        }
+        else
+        {
+            for (unsigned i = 0; i != 8; ++i)
+            {
+                window <<= 8;
+                if (byteIndex + i < m_byteCount)
+                    window |= m_data[byteIndex + i];
+            }
+        }
+        return (window << (m_position % 8)) >> (64 - length);
+    }
+
+    void skip(unsigned length)
+    {
+        m_position += length;
+    }
+
+    std::uint64_t position() const
+    {
+        return m_position;
+    }
+
+private:
+    const std::uint8_t* m_data;
+    std::uint64_t m_byteCount;
+    std::uint64_t m_position;
+};
@@ -0,0 +1,65 @@
+#include <cstring>
+#include "crc32c.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <nmmintrin.h>
+#define CRC32C_HAS_SSE42_PATH 1
+#endif
+
+static std::uint32_t const CRC32C_POLYNOMIAL = 0x82F63B78;
+
+    struct Crc32cTable
+    {
+        std::uint32_t m_entries[256];
+
+        Crc32cTable()
+        {
+            for (std::uint32_t i = 0; i != 256; ++i)
+            {
+                std::uint32_t crc = i;
+                for (int bit = 0; bit != 8; ++bit)
+                    crc = (crc >> 1) ^ (CRC32C_POLYNOMIAL & (0 - (crc & 1)));
+                m_entries[i] = crc;
+            }
+        }
+    };
+
+    static std::uint32_t crc32cSoftware(std::uint32_t crc, const std::uint8_t* data, std::size_t size)
+    {
+        static const Crc32cTable table;
+        for (std::size_t i = 0; i != size; ++i)
+            crc = table.m_entries[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+        return crc;
+    }
+
+#ifdef CRC32C_HAS_SSE42_PATH
+    __attribute__((target("sse4.2")))
+    static std::uint32_t crc32cHardware(std::uint32_t crc, const std::uint8_t* data, std::size_t size)
+    {
+#if defined(__x86_64__)
+        std::uint64_t wide = crc;
+        for (; size >= sizeof(std::uint64_t); size -= sizeof(std::uint64_t), data += sizeof(std::uint64_t))
+        {
+            std::uint64_t word;
+            memcpy(&word, data, sizeof(word));
+            wide = _mm_crc32_u64(wide, word);
+        }
+        crc = (std::uint32_t)wide;
+#endif
+        for (; size != 0; --size, ++data)
+            crc = _mm_crc32_u8(crc, *data);
+        return crc;
+    }
+#endif
+
+    std::uint32_t crc32c(std::uint32_t crc, const void* data, std::size_t size)
+    {
+        const std::uint8_t* bytes = (const std::uint8_t*)data;
+        crc = ~crc;
+#ifdef CRC32C_HAS_SSE42_PATH
+        static const bool hasHardware = __builtin_cpu_supports("sse4.2");
+        if (hasHardware)
+            return ~crc32cHardware(crc, bytes, size);
+#endif
+        return ~crc32cSoftware(crc, bytes, size);
+    }
@@ -0,0 +1,6 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// CRC-32C (Castagnoli). Pass the previous result as `crc` to continue a running checksum, 0 to start one.
+std::uint32_t crc32c(std::uint32_t crc, const void* data, std::size_t size);
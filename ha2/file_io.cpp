@@ -0,0 +1,144 @@
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "file_io.hpp"
+
+static std::size_t const WRITE_BUFFER_SIZE = std::size_t(1) << 20;
+
+    MappedFile::MappedFile()
+        :m_data(nullptr)
+        ,m_size(0)
+    {    }
+
+    MappedFile::~MappedFile()
+    {
+        close();
+    }
+
+    bool MappedFile::open(const std::string& fileName)
+    {
+        close();
+        int descriptor = ::open(fileName.c_str(), O_RDONLY);
+        if (descriptor < 0)
+            return false;
+
+        struct stat info;
+        if (fstat(descriptor, &info) != 0 || !S_ISREG(info.st_mode))
+        {
+            ::close(descriptor);
+            return false;
+        }
+
+        // mmap rejects zero-length mappings, an empty file is just an empty range
+        if (info.st_size != 0)
+        {
+            void* mapping = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+            if (mapping == MAP_FAILED)
+            {
+                ::close(descriptor);
+                return false;
+            }
+            madvise(mapping, info.st_size, MADV_SEQUENTIAL);
+            m_data = (const std::uint8_t*)mapping;
+            m_size = info.st_size;
+        }
+        ::close(descriptor);
+        return true;
+    }
+
+    void MappedFile::close()
+    {
+        if (m_data != nullptr)
+            munmap((void*)m_data, m_size);
+        m_data = nullptr;
+        m_size = 0;
+    }
+
+    const std::uint8_t* MappedFile::data() const
+    {
+        return m_data;
+    }
+
+    std::size_t MappedFile::size() const
+    {
+        return m_size;
+    }
+
+    FileWriter::FileWriter()
+        :m_descriptor(-1)
+        ,m_failed(false)
+        ,m_buffer(WRITE_BUFFER_SIZE)
+        ,m_position(0)
+        ,m_flushed(0)
+    {    }
+
+    FileWriter::~FileWriter()
+    {
+        close();
+    }
+
+    bool FileWriter::open(const std::string& fileName)
+    {
+        close();
+        m_descriptor = ::open(fileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        m_failed = (m_descriptor < 0);
+        m_position = 0;
+        m_flushed = 0;
+        return !m_failed;
+    }
+
+    bool FileWriter::close()
+    {
+        if (m_descriptor < 0)
+            return !m_failed;
+        flush();
+        if (::close(m_descriptor) != 0)
+            m_failed = true;
+        m_descriptor = -1;
+        return !m_failed;
+    }
+
+    void FileWriter::write(const void* data, std::size_t size)
+    {
+        const std::uint8_t* bytes = (const std::uint8_t*)data;
+        while (size != 0)
+        {
+            if (m_position == m_buffer.size())
+                flush();
+            std::size_t part = std::min(size, m_buffer.size() - m_position);
+            memcpy(m_buffer.data() + m_position, bytes, part);
+            m_position += part;
+            bytes += part;
+            size -= part;
+        }
+    }
+
+    bool FileWriter::flush()
+    {
+        const std::uint8_t* bytes = m_buffer.data();
+        std::size_t size = m_position;
+        while (size != 0 && !m_failed)
+        {
+            ssize_t done = ::write(m_descriptor, bytes, size);
+            if (done < 0)
+            {
+                if (errno != EINTR)
+                    m_failed = true;
+                continue;
+            }
+            bytes += done;
+            size -= done;
+        }
+        m_flushed += m_position;
+        m_position = 0;
+        return !m_failed;
+    }
+
+    std::uint64_t FileWriter::written() const
+    {
+        return m_flushed + m_position;
+    }
@@ -0,0 +1,86 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+class MappedFile
+{
+public:
+    MappedFile();
+    ~MappedFile();
+    bool open(const std::string& fileName);
+    void close();
+    const std::uint8_t* data() const;
+    std::size_t size() const;
+private:
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+    const std::uint8_t* m_data;
+    std::size_t m_size;
+};
+
+class FileWriter
+{
+public:
+    FileWriter();
+    ~FileWriter();
+    bool open(const std::string& fileName);
+    bool close();
+    void write(const void* data, std::size_t size);
+    void put(std::uint8_t byte)
+    {
+        if (m_position == m_buffer.size())
+            flush();
+        m_buffer[m_position++] = byte;
+    }
+    bool flush();
+    std::uint64_t written() const;
+private:
+    FileWriter(const FileWriter&);
+    FileWriter& operator=(const FileWriter&);
+    int m_descriptor;
+    bool m_failed;
+    std::vector<std::uint8_t> m_buffer;
+    std::size_t m_position;
+    std::uint64_t m_flushed;
+};
+
+class MemoryWriter
+{
+public:
+    MemoryWriter(std::uint8_t* data, std::size_t capacity)
+        :m_data(data)
+        ,m_capacity(capacity)
+        ,m_position(0)
+        ,m_failed(false)
+    {    }
+    void put(std::uint8_t byte)
+    {
+        if (m_position == m_capacity)
+        {
+            m_failed = true;
+            return;
+        }
+        m_data[m_position++] = byte;
+    }
+    void write(const void* data, std::size_t size)
+    {
+        const std::uint8_t* bytes = (const std::uint8_t*)data;
+        for (std::size_t i = 0; i != size; ++i)
+            put(bytes[i]);
+    }
+    bool failed() const
+    {
+        return m_failed;
+    }
+    std::size_t written() const
+    {
+        return m_position;
+    }
+private:
+    std::uint8_t* m_data;
+    std::size_t m_capacity;
+    std::size_t m_position;
+    bool m_failed;
+};
@@ -1,11 +1,11 @@
 #include <string>
 #include <iostream>
-#include <fstream>
 #include <algorithm>
-#include <queue>
 #include <vector>
 #include <cstring>
+#include <thread>
 #include "huffman.hpp"
+#include "crc32c.hpp"
 
 using namespace std;
 
@@ -13,12 +13,191 @@ static int const BITS_IN_BYTE = 8;
 
 static int const SIZE_OF_ARRAY = 256;
 
+static int const HISTOGRAM_SUB_TABLES = 4;
+
+static size_t const HISTOGRAM_CHUNK_SIZE = size_t(1) << 30;
+
+static size_t const HISTOGRAM_MIN_THREAD_SIZE = size_t(1) << 22;
+
+static uint32_t const DEFAULT_BLOCK_SIZE = 1 << 16;
+
+static size_t const MAX_VARINT_SIZE = 10;
+
+    static void appendLittleEndian(std::vector<uint8_t>& buffer, uint64_t value, size_t size)
+    {
+        for (size_t i = 0; i != size; ++i)
+        {
+            buffer.push_back((uint8_t)(value >> (BITS_IN_BYTE * i)));
+        }
+    }
+
+    static void storeLittleEndian(uint8_t* data, uint64_t value, size_t size)
+    {
+        for (size_t i = 0; i != size; ++i)
+        {
+            data[i] = (uint8_t)(value >> (BITS_IN_BYTE * i));
+        }
+    }
+
+    static void putVarint(MemoryWriter& output, uint64_t value)
+    {
+        while (value >= 0x80)
+        {
+            output.put((uint8_t)(value | 0x80));
+            value >>= 7;
+        }
+        output.put((uint8_t)value);
+    }
+
+    static uint64_t getVarint(const uint8_t* data, size_t length, size_t& index)
+    {
+        uint64_t value = 0;
+        for (size_t shift = 0; index < length && shift < 64; shift += 7)
+        {
+            uint8_t byte = data[index++];
+            value |= (uint64_t)(byte & 0x7F) << shift;
+            if ((byte & 0x80) == 0)
+                return value;
+        }
+        throw HuffmanCode::HuffmanCodeException("Incorrect input buffer");
+    }
+
+    static uint64_t loadLittleEndian(const uint8_t* data, size_t size)
+    {
+        uint64_t value = 0;
+        for (size_t i = size; i-- != 0; )
+        {
+            value = (value << BITS_IN_BYTE) | data[i];
+        }
+        return value;
+    }
+
+    // Counts into several sub-tables so that runs of one byte value do not
+    // serialize on the same counter; 32-bit counters are flushed every chunk.
+    static void countBytes(const uint8_t* data, size_t length, uint64_t* frequency)
+    {
+        uint32_t counts[HISTOGRAM_SUB_TABLES * SIZE_OF_ARRAY] = {};
+        uint32_t* table0 = counts;
+        uint32_t* table1 = table0 + SIZE_OF_ARRAY;
+        uint32_t* table2 = table1 + SIZE_OF_ARRAY;
+        uint32_t* table3 = table2 + SIZE_OF_ARRAY;
+
+        while (length != 0)
+        {
+            size_t chunk = std::min(length, HISTOGRAM_CHUNK_SIZE);
+            const uint8_t* end = data + chunk;
+            for (; end - data >= 16; data += 16)
+            {
+                uint64_t first, second;
+                memcpy(&first, data, sizeof(uint64_t));
+                memcpy(&second, data + sizeof(uint64_t), sizeof(uint64_t));
+
+                ++table0[(uint8_t)first];
+                ++table1[(uint8_t)(first >> 8)];
+                ++table2[(uint8_t)(first >> 16)];
+                ++table3[(uint8_t)(first >> 24)];
+                ++table0[(uint8_t)(first >> 32)];
+                ++table1[(uint8_t)(first >> 40)];
+                ++table2[(uint8_t)(first >> 48)];
+                ++table3[(uint8_t)(first >> 56)];
+
+                ++table0[(uint8_t)second];
+                ++table1[(uint8_t)(second >> 8)];
+                ++table2[(uint8_t)(second >> 16)];
+                ++table3[(uint8_t)(second >> 24)];
+                ++table0[(uint8_t)(second >> 32)];
+                ++table1[(uint8_t)(second >> 40)];
+                ++table2[(uint8_t)(second >> 48)];
+                ++table3[(uint8_t)(second >> 56)];
+            }
+            for (; data != end; ++data)
+            {
+                ++table0[*data];
+            }
+            length -= chunk;
+
+            for (size_t i = 0; i != SIZE_OF_ARRAY; ++i)
+            {
+                frequency[i] += (uint64_t)table0[i] + table1[i] + table2[i] + table3[i];
+                table0[i] = table1[i] = table2[i] = table3[i] = 0;
+            }
+        }
+    }
+
+    static void countBytesParallel(const uint8_t* data, size_t length, uint64_t* frequency)
+    {
+        size_t threadCount = length / HISTOGRAM_MIN_THREAD_SIZE;
+        if (threadCount >= 2)
+        {
+            threadCount = std::min<size_t>(threadCount, std::thread::hardware_concurrency());
+        }
+        if (threadCount < 2)
+        {
+            countBytes(data, length, frequency);
+            return;
+        }
+
+        std::vector<uint64_t> partial((threadCount - 1) * SIZE_OF_ARRAY, 0);
+        std::vector<std::thread> workers;
+        size_t part = length / threadCount;
+        for (size_t i = 0; i + 1 < threadCount; ++i)
+        {
+            workers.push_back(std::thread(countBytes, data + i * part, part, partial.data() + i * SIZE_OF_ARRAY));
+        }
+        size_t done = (threadCount - 1) * part;
+        countBytes(data + done, length - done, frequency);
+
+        for (size_t i = 0; i + 1 < threadCount; ++i)
+        {
+            workers[i].join();
+            for (size_t j = 0; j != SIZE_OF_ARRAY; ++j)
+            {
+                frequency[j] += partial[i * SIZE_OF_ARRAY + j];
+            }
+        }
+    }
+
+uint8_t const HuffmanCode::CONTAINER_MAGIC[MAGIC_SIZE] = { 'H', 'U', 'F', 'C' };
+
+uint8_t const HuffmanCode::INDEX_MAGIC[MAGIC_SIZE] = { 'H', 'U', 'F', 'I' };
+
     HuffmanCode::HuffmanCode()
-        :m_headCharNode(0)
+        :m_maxCodeLength(MAX_CODE_LENGTH)
+        ,m_contextModeling(false)
+        ,m_ansBackend(false)
+        ,m_blockSize(DEFAULT_BLOCK_SIZE)
     {
         clear();
     }
 
+    void HuffmanCode::setMaxCodeLength(unsigned maxCodeLength)
+    {
+        if (maxCodeLength < MIN_CODE_LENGTH_LIMIT || maxCodeLength > MAX_CODE_LENGTH)
+        {
+            throw HuffmanCodeException("Incorrect maximum code length");
+        }
+        m_maxCodeLength = maxCodeLength;
+    }
+
+    void HuffmanCode::setContextModeling(bool enabled)
+    {
+        m_contextModeling = enabled;
+    }
+
+    void HuffmanCode::setAnsBackend(bool enabled)
+    {
+        m_ansBackend = enabled;
+    }
+
+    void HuffmanCode::setBlockSize(uint32_t blockSize)
+    {
+        if (blockSize == 0 || blockSize > MAX_BLOCK_SIZE)
+        {
+            throw HuffmanCodeException("Incorrect block size");
+        }
+        m_blockSize = blockSize;
+    }
+
     HuffmanCode::~HuffmanCode()
     {
         clear();
@@ -27,43 +206,263 @@ static int const SIZE_OF_ARRAY = 256;
     void HuffmanCode::compress(const std::string& inputFile, const std::string& outputFile)
     {
         clear();        
-        std::ifstream input(inputFile, std::ifstream::binary);
-        if (!input)
+        MappedFile input;
+        if (!input.open(inputFile))
         {
             throw HuffmanCodeException("Cannot open input file");
         }
-        std::ofstream output(outputFile, std::ofstream::binary);
+        FileWriter output;
+        if (!output.open(outputFile))
+        {
+            throw HuffmanCodeException("Cannot open output file");
+        }
     
-        countCharFrequency(input);
-        calculateCodeTable();
-        writeCodeTable(input, output);
+        const uint8_t* data = input.data();
+        size_t length = input.size();
+        if (m_ansBackend && m_contextModeling)
+        {
+            throw HuffmanCodeException("ANS backend supports only the order-0 model");
+        }
+        m_model = m_ansBackend ? RANS_MODEL : (m_contextModeling ? ORDER_1_MODEL : ORDER_0_MODEL);
+        m_originalSize = length;
+        m_containerBlockSize = m_blockSize;
+        countCharFrequency(data, length);
+        if (m_model == RANS_MODEL)
+        {
+            m_rans.normalize(m_charFrequency);
+        }
+        else
+        {
+            calculateCodeTable(m_charFrequency, m_codeTable);
+        }
+        if (m_model == ORDER_1_MODEL)
+        {
+            countContextFrequency(data, length);
+            for (size_t i = 0; i != SIZE_OF_ARRAY; ++i)
+            {
+                calculateCodeTable(&m_contextFrequency[i * SIZE_OF_ARRAY], m_contextTables[i]);
+            }
+        }
+
+        std::vector<uint8_t> header(CONTAINER_MAGIC, CONTAINER_MAGIC + MAGIC_SIZE);
+        header.push_back((uint8_t)CONTAINER_VERSION);
+        header.push_back(m_model);
+        appendLittleEndian(header, 0, sizeof(uint16_t));
+        appendLittleEndian(header, m_originalSize, sizeof(uint64_t));
+        appendLittleEndian(header, m_containerBlockSize, sizeof(uint32_t));
+        appendLittleEndian(header, 0, sizeof(uint32_t));
+        writeCodeTable(header);
+        size_t tableSize = header.size() - CONTAINER_HEADER_SIZE;
+        storeLittleEndian(&header[CONTAINER_HEADER_SIZE - sizeof(uint32_t)], tableSize, sizeof(uint32_t));
+        appendLittleEndian(header, crc32c(0, header.data(), header.size()), sizeof(uint32_t));
+        output.write(header.data(), header.size());
+        m_sizeOfAdditionalInfo = header.size();
+
+        writeBlocks(data, length, output);
+        writeIndex(output);
+        if (!output.close())
+        {
+            throw HuffmanCodeException("Cannot write output file");
+        }
+
+        uint64_t payloadSize = output.written() - m_sizeOfAdditionalInfo;
+        cout << length << endl << payloadSize << endl << m_sizeOfAdditionalInfo << endl;
+        if (m_model == ORDER_1_MODEL)
+        {
+            // What the order-0 coder would have written, ignoring per-block padding,
+            // so the gain of the context model can be judged.
+            uint64_t order0BitsCount = 0;
+            for (size_t i = 0; i != SIZE_OF_ARRAY; ++i)
+            {
+                order0BitsCount += m_charFrequency[i] * m_codeTable.m_length[i];
+            }
+            uint64_t order0Size = m_sizeOfAdditionalInfo - tableSize + sizeof(uint16_t) + 2 * sizeof(uint8_t) * m_charCount
+                + (order0BitsCount / BITS_IN_BYTE) + ((order0BitsCount % BITS_IN_BYTE) != 0);
+            cout << order0Size << endl;
+        }
     }
     
     void HuffmanCode::unpack(const std::string& inputFile, const std::string& outputFile)
     {
         clear();
-        std::ifstream input(inputFile, std::ifstream::binary);
-        if (!input)
+        MappedFile input;
+        if (!input.open(inputFile))
+            throw HuffmanCodeException("Cannot open input file");
+        FileWriter output;
+        if (!output.open(outputFile))
+            throw HuffmanCodeException("Cannot open output file");
+
+        readContainer(input.data(), input.size());
+        uint64_t payloadSize = 0;
+        for (size_t i = 0; i != m_blocks.size(); ++i)
+        {
+            output.write(m_blockBuffer.data(), decodeBlock(i));
+            payloadSize += m_blocks[i].m_size;
+        }
+        m_container = 0;
+        if (!output.close())
+            throw HuffmanCodeException("Cannot write output file");
+
+        cout << payloadSize << endl << m_originalSize << endl << m_sizeOfAdditionalInfo << endl;
+    }
+
+    void HuffmanCode::extract(const std::string& inputFile, const std::string& outputFile, uint64_t offset, uint64_t length)
+    {
+        clear();
+        MappedFile input;
+        if (!input.open(inputFile))
             throw HuffmanCodeException("Cannot open input file");
-        std::ofstream output(outputFile, std::ofstream::binary);
+        FileWriter output;
+        if (!output.open(outputFile))
+            throw HuffmanCodeException("Cannot open output file");
 
-        readCodeTable(input);
-        writeDecompressedFile(output);
+        readContainer(input.data(), input.size());
+        if (offset > m_originalSize || length > m_originalSize - offset)
+            throw HuffmanCodeException("Incorrect range");
+
+        uint64_t payloadSize = 0;
+        if (length != 0)
+        {
+            size_t firstBlock = offset / m_containerBlockSize;
+            size_t lastBlock = (offset + length - 1) / m_containerBlockSize;
+            for (size_t i = firstBlock; i <= lastBlock; ++i)
+            {
+                uint64_t blockStart = (uint64_t)i * m_containerBlockSize;
+                size_t blockLength = decodeBlock(i);
+                size_t from = std::max(offset, blockStart) - blockStart;
+                size_t to = std::min(offset + length, blockStart + blockLength) - blockStart;
+                output.write(m_blockBuffer.data() + from, to - from);
+                payloadSize += m_blocks[i].m_size;
+            }
+        }
+        m_container = 0;
+        if (!output.close())
+            throw HuffmanCodeException("Cannot write output file");
+
+        cout << payloadSize << endl << length << endl << m_sizeOfAdditionalInfo << endl;
+    }
+
+    void HuffmanCode::countFrequency(const uint8_t* data, size_t length, uint64_t* frequency)
+    {
+        countBytesParallel(data, length, frequency);
+    }
+
+    void HuffmanCode::buildCodeTable(const uint64_t* frequency)
+    {
+        calculateCodeTable(frequency, m_codeTable);
     }
 
-    void HuffmanCode::countCharFrequency(std::istream& input)
+    size_t HuffmanCode::encode(const uint8_t* input, size_t inputSize, uint8_t* output, size_t outputCapacity) const
     {
-        input.seekg (0, input.end);
-        unsigned length = (unsigned) input.tellg();
-        input.seekg (0, input.beg);
-        std::vector<char> buffer(length);
-        input.read (buffer.data(),length);
+        MemoryWriter writer(output, outputCapacity);
+        BitWriter<MemoryWriter> bitWriter(writer);
+        encodeSymbols(input, inputSize, m_codeTable, bitWriter);
+        if (writer.failed())
+            throw HuffmanCodeException("Output buffer is too small");
+        return writer.written();
+    }
+
+    size_t HuffmanCode::decode(const uint8_t* input, size_t inputSize, uint8_t* output, size_t outputSize) const
+    {
+        return decodeMessage(input, inputSize, 0, outputSize, output, outputSize, m_codeTable);
+    }
+
+    size_t HuffmanCode::compressBound(size_t inputSize)
+    {
+        // an optimal code never loses to the plain 8-bit one, so the bits fit in inputSize bytes
+        return MAX_VARINT_SIZE + sizeof(uint8_t) + 2 * sizeof(uint8_t) * SIZE_OF_ARRAY + inputSize;
+    }
+
+    size_t HuffmanCode::compress(const uint8_t* input, size_t inputSize, uint8_t* output, size_t outputCapacity)
+    {
+        for (size_t i = 0; i != SIZE_OF_ARRAY; ++i)
+        {
+            m_charFrequency[i] = 0;
+        }
+        m_charCount = 0;
+        countCharFrequency(input, inputSize);
+        calculateCodeTable(m_charFrequency, m_codeTable);
+
+        MemoryWriter writer(output, outputCapacity);
+        putVarint(writer, inputSize);
+        if (inputSize != 0)
+        {
+            writer.put((uint8_t)(m_charCount - 1));
+            for (size_t i = 0; i != SIZE_OF_ARRAY; ++i)
+                if (m_codeTable.m_length[i] != 0)
+                {
+                    writer.put((uint8_t) i);
+                    writer.put(m_codeTable.m_length[i]);
+                }
+            BitWriter<MemoryWriter> bitWriter(writer);
+            encodeSymbols(input, inputSize, m_codeTable, bitWriter);
+        }
+        if (writer.failed())
+            throw HuffmanCodeException("Output buffer is too small");
+        return writer.written();
+    }
+
+    size_t HuffmanCode::unpack(const uint8_t* input, size_t inputSize, uint8_t* output, size_t outputCapacity)
+    {
+        size_t index = 0;
+        uint64_t outputSize = getVarint(input, inputSize, index);
+        if (outputSize == 0)
+            return 0;
+        if (index == inputSize)
+            throw HuffmanCodeException("Incorrect input buffer");
+
+        m_codeTable.clear();
+        size_t symbolCount = input[index++] + 1;
+        readCodeLengths(input, inputSize, index, symbolCount, m_codeTable);
+        return decodeMessage(input, inputSize, index, outputSize, output, outputCapacity, m_codeTable);
+    }
 
+    size_t HuffmanCode::compress(const uint8_t* input, size_t inputSize, uint8_t* output, size_t outputCapacity, const Dictionary& dictionary) const
+    {
+        MemoryWriter writer(output, outputCapacity);
+        putVarint(writer, inputSize);
+        BitWriter<MemoryWriter> bitWriter(writer);
+        encodeSymbols(input, inputSize, dictionary.m_table, bitWriter);
+        if (writer.failed())
+            throw HuffmanCodeException("Output buffer is too small");
+        return writer.written();
+    }
+
+    size_t HuffmanCode::unpack(const uint8_t* input, size_t inputSize, uint8_t* output, size_t outputCapacity, const Dictionary& dictionary) const
+    {
+        size_t index = 0;
+        uint64_t outputSize = getVarint(input, inputSize, index);
+        return decodeMessage(input, inputSize, index, outputSize, output, outputCapacity, dictionary.m_table);
+    }
+
+    void HuffmanCode::encodeSymbols(const uint8_t* data, size_t length, const CodeTable& table, BitWriter<MemoryWriter>& writer) const
+    {
         for (size_t i = 0; i < length; ++i)
         {
-            uint8_t index = buffer[i];
-            ++m_charFrequency[index];
+            writer.write(table.m_code[data[i]], table.m_length[data[i]]);
+        }
+        writer.flush();
+    }
+
+    size_t HuffmanCode::decodeMessage(const uint8_t* input, size_t inputSize, size_t index, uint64_t outputSize, uint8_t* output, size_t outputCapacity, const CodeTable& table) const
+    {
+        if (outputSize > outputCapacity)
+            throw HuffmanCodeException("Output buffer is too small");
+
+        uint64_t bitCount = (uint64_t)(inputSize - index) * BITS_IN_BYTE;
+        BitReader reader(input + index, bitCount);
+        for (size_t i = 0; i != outputSize; ++i)
+        {
+            output[i] = table.decode(reader);
         }
+        if (reader.position() > bitCount)
+            throw HuffmanCodeException("Incorrect input buffer");
+        return outputSize;
+    }
+
+    void HuffmanCode::countCharFrequency(const uint8_t* data, size_t length)
+    {
+        countBytesParallel(data, length, m_charFrequency);
 
         for (size_t i = 0; i != SIZE_OF_ARRAY; ++i)
         {
@@ -74,271 +473,631 @@ static int const SIZE_OF_ARRAY = 256;
         }
     }
 
-    void HuffmanCode::calculateCodeTable()
+    void HuffmanCode::countContextFrequency(const uint8_t* data, size_t length)
     {
-        std::priority_queue<CharNode*, std::vector<CharNode*>, CompCharNodePointer> myQueue;
-        for (size_t i = 0; i != SIZE_OF_ARRAY; ++i)
+        m_contextFrequency.assign(SIZE_OF_ARRAY * SIZE_OF_ARRAY, 0);
+        m_contextTables.resize(SIZE_OF_ARRAY);
+        for (size_t start = 0; start < length; start += m_containerBlockSize)
         {
-            CharNode* newCharNode;
-            if (m_charFrequency[i] != 0)
+            // every block starts in context 0 so that it decodes on its own
+            size_t end = start + std::min<size_t>(m_containerBlockSize, length - start);
+            size_t context = 0;
+            for (size_t i = start; i < end; ++i)
             {
-                newCharNode = new CharNode(i, m_charFrequency[i]);
-                myQueue.push(newCharNode);
+                ++m_contextFrequency[context + data[i]];
+                context = data[i] * SIZE_OF_ARRAY;
             }
         }
+    }
 
-        while (myQueue.size() > 2)
+    void HuffmanCode::calculateCodeTable(const uint64_t* frequency, CodeTable& table)
+    {
+        table.clear();
+        size_t leafCount = 0;
+        for (size_t i = 0; i != SIZE_OF_ARRAY; ++i)
         {
-            CharNode* firstCharNode = myQueue.top();
-            myQueue.pop();
-            CharNode* secondCharNode = myQueue.top();
-            myQueue.pop();
-
-            CharNode* newCharNode;
-            newCharNode = new CharNode(0, firstCharNode->m_frequency + secondCharNode->m_frequency, firstCharNode, secondCharNode);
-            myQueue.push(newCharNode);
+            if (frequency[i] != 0)
+            {
+                m_nodes[leafCount].m_frequency = frequency[i];
+                m_nodes[leafCount].m_char = i;
+                ++leafCount;
+            }
         }
+        if (leafCount == 0)
+            return;
 
-        if (myQueue.size() == 2)
+        if (leafCount == 1)
+        {
+            m_nodes[0].m_depth = 1;
+        }
+        else
         {
-            CharNode* firstCharNode = myQueue.top();
-            myQueue.pop();
-            CharNode* secondCharNode = myQueue.top();
-            myQueue.pop();
+            std::sort(m_nodes, m_nodes + leafCount, CompCharNode());
 
-            CharNode* newCharNode;
-            newCharNode = new CharNode(0, firstCharNode->m_frequency + secondCharNode->m_frequency, firstCharNode, secondCharNode);
-            m_headCharNode = newCharNode;
+            // Leaves are sorted and internal nodes are created in non-decreasing order,
+            // so the two lightest nodes are always at the heads of these two queues.
+            size_t leafHead = 0;
+            size_t nodeHead = leafCount;
+            size_t nodeTail = leafCount;
+            while (nodeTail != 2 * leafCount - 1)
+            {
+                size_t children[2];
+                for (size_t j = 0; j != 2; ++j)
+                {
+                    if (leafHead != leafCount && (nodeHead == nodeTail || m_nodes[leafHead].m_frequency <= m_nodes[nodeHead].m_frequency))
+                        children[j] = leafHead++;
+                    else
+                        children[j] = nodeHead++;
+                }
+                m_nodes[nodeTail].m_frequency = m_nodes[children[0]].m_frequency + m_nodes[children[1]].m_frequency;
+                m_nodes[children[0]].m_parent = nodeTail;
+                m_nodes[children[1]].m_parent = nodeTail;
+                ++nodeTail;
+            }
 
-            m_headCharNode->zero->toTable(m_codeTable, "0");
-            m_headCharNode->one->toTable(m_codeTable, "1");
+            size_t root = nodeTail - 1;
+            m_nodes[root].m_depth = 0;
+            for (size_t i = root; i-- != 0; )
+            {
+                m_nodes[i].m_depth = m_nodes[m_nodes[i].m_parent].m_depth + 1;
+            }
         }
-        else
-        if (myQueue.size() == 1)
+
+        uint16_t maxDepth = 0;
+        for (size_t i = 0; i != leafCount; ++i)
         {
-            CharNode* firstCharNode = myQueue.top();
-            myQueue.pop();
-            m_headCharNode = firstCharNode;
-            m_headCharNode->toTable(m_codeTable, "0");
+            maxDepth = std::max(maxDepth, m_nodes[i].m_depth);
         }
+        if (maxDepth > m_maxCodeLength)
+        {
+            limitCodeLengths(leafCount);
+        }
+
+        for (size_t i = 0; i != leafCount; ++i)
+        {
+            table.m_length[m_nodes[i].m_char] = m_nodes[i].m_depth;
+        }
+        if (!table.assignCanonicalCodes())
+            throw HuffmanCodeException("Incorrect code table");
     }
 
-    void HuffmanCode::writeCodeTable(std::istream& input, std::ostream& output)
+    // Package-merge: every leaf is offered once per allowed level, pairs of the cheapest
+    // items are packaged into the level above, and the 2n - 2 cheapest items of the top
+    // level decide how many levels each leaf takes part in, which is its code length.
+    void HuffmanCode::limitCodeLengths(size_t leafCount)
     {
-        m_sizeOfAdditionalInfo = 0;
-		std::uint64_t m_charCountuint = (std::uint64_t)m_charCount;
-        output.write((char*)&m_charCountuint, sizeof(std::uint64_t));
-        m_sizeOfAdditionalInfo += sizeof(std::uint64_t);
+        size_t levelSize = 2 * leafCount;
+        std::vector<uint64_t> weights(levelSize);
+        std::vector<int16_t> items(m_maxCodeLength * levelSize);
+        std::vector<size_t> itemCount(m_maxCodeLength);
 
-        if (m_charCount != 0)
+        // items of a level hold the leaf index, or -1 for a package of two items of the level below
+        int16_t* deepest = items.data() + (m_maxCodeLength - 1) * levelSize;
+        for (size_t i = 0; i != leafCount; ++i)
         {
-            for (size_t i = 0; i < SIZE_OF_ARRAY; ++i)
-                if (m_charFrequency[i] != 0)
-                {
-                    output << (uint8_t) i;
-                    output.write((char*)&m_charFrequency[i], sizeof(std::uint64_t));
-                    m_sizeOfAdditionalInfo += sizeof(uint8_t) + sizeof(std::uint64_t);
-                }
-        
+            weights[i] = m_nodes[i].m_frequency;
+            deepest[i] = i;
+        }
+        itemCount[m_maxCodeLength - 1] = leafCount;
 
-            input.clear();
+        std::vector<uint64_t> packages(leafCount);
+        for (size_t level = m_maxCodeLength - 1; level-- != 0; )
+        {
+            size_t packageCount = itemCount[level + 1] / 2;
+            for (size_t i = 0; i != packageCount; ++i)
             {
-                input.seekg (0, input.end);
-                unsigned length = (unsigned) input.tellg();
-                input.seekg (0, input.beg);
-
-                std::vector<char> ReadingBuffer(length);
-                input.read (ReadingBuffer.data(),length);
-
-                std::vector<char> buffer(length * BITS_IN_BYTE, 0);
- //               memset(buffer.data(), 0, length * BITS_IN_BYTE);
-                size_t allBitsCount = 0;
-                size_t bitBufferPointer = 0;
-                size_t charBufferPointer = 0;
+                packages[i] = weights[2 * i] + weights[2 * i + 1];
+            }
 
-                for (size_t i = 0; i < length; ++i)
+            int16_t* current = items.data() + level * levelSize;
+            size_t leafHead = 0;
+            size_t packageHead = 0;
+            size_t count = 0;
+            while (leafHead != leafCount || packageHead != packageCount)
+            {
+                if (packageHead == packageCount || (leafHead != leafCount && m_nodes[leafHead].m_frequency <= packages[packageHead]))
                 {
-                    uint8_t index = ReadingBuffer[i];
-                    size_t sizeOfString = m_codeTable[index].size();
-                    allBitsCount += sizeOfString;
-
-                    for(size_t jString = 0; jString < sizeOfString; ++jString)
-                    {
-                        buffer[charBufferPointer] += m_codeTable[index][jString] - '0';
-                        ++bitBufferPointer;
-                        if (bitBufferPointer % BITS_IN_BYTE == 0)
-                            ++charBufferPointer;
-                        else
-                            buffer[charBufferPointer]<<=1;
-                    }
+                    weights[count] = m_nodes[leafHead].m_frequency;
+                    current[count++] = leafHead++;
                 }
-
-                ++bitBufferPointer;
-                while (bitBufferPointer % BITS_IN_BYTE != 0)
+                else
                 {
-                    buffer[charBufferPointer]<<=1;
-                    ++bitBufferPointer;
+                    weights[count] = packages[packageHead++];
+                    current[count++] = -1;
                 }
+            }
+            itemCount[level] = count;
+        }
 
-                output.write((char*)&allBitsCount, sizeof(std::uint64_t));
-                m_sizeOfAdditionalInfo += sizeof(std::uint64_t);
-                size_t sizeOfBuffer = (allBitsCount / BITS_IN_BYTE) + ((allBitsCount % BITS_IN_BYTE) != 0);
-                output.write(buffer.data(), sizeOfBuffer);
-
-                cout << length << endl << sizeOfBuffer << endl << m_sizeOfAdditionalInfo << endl;
+        for (size_t i = 0; i != leafCount; ++i)
+        {
+            m_nodes[i].m_depth = 0;
+        }
+        size_t selected = 2 * leafCount - 2;
+        for (size_t level = 0; level != m_maxCodeLength && selected != 0; ++level)
+        {
+            const int16_t* current = items.data() + level * levelSize;
+            size_t packageCount = 0;
+            for (size_t i = 0; i != selected; ++i)
+            {
+                if (current[i] < 0)
+                    ++packageCount;
+                else
+                    ++m_nodes[current[i]].m_depth;
             }
+            selected = 2 * packageCount;
         }
-        else
-            cout << 0 << endl << 0 << endl << m_sizeOfAdditionalInfo << endl;
     }
 
-    void HuffmanCode::readCodeTable(std::istream& input)
+    void HuffmanCode::writeCodeTable(std::vector<uint8_t>& header) const
     {
-        m_sizeOfAdditionalInfo = 0;
-        input.seekg (0, input.end);
-        unsigned length = (unsigned) input.tellg();
-        input.seekg (0, input.beg);
-        std::vector<char> buffer(length);
-        input.read (buffer.data(),length);
-        m_charCount = *((std::uint64_t*)buffer.data());
-        m_sizeOfAdditionalInfo += sizeof(std::uint64_t);
-        if (m_charCount != 0)
-        {
-            for (size_t i = 0; i < m_charCount; ++i)
-            {
-                size_t index = (sizeof(uint8_t) + sizeof(std::uint64_t)) * i;
-                if (index + sizeof(uint8_t) + sizeof(std::uint64_t) >= length)
+        if (m_model == RANS_MODEL)
+        {
+            const uint16_t* frequency = m_rans.frequencies();
+            appendLittleEndian(header, m_charCount, sizeof(uint16_t));
+            for (size_t i = 0; i != SIZE_OF_ARRAY; ++i)
+                if (frequency[i] != 0)
                 {
-                    throw HuffmanCodeException("Incorrect input file");
+                    header.push_back((uint8_t) i);
+                    appendLittleEndian(header, frequency[i], sizeof(uint16_t));
                 }
-                m_charFrequency[(uint8_t)buffer[index + sizeof(std::uint64_t)]] = *((std::uint64_t*)(buffer.data() + index + sizeof(uint8_t) + sizeof(std::uint64_t)));
-                int n = 0;
-            }
-            m_sizeOfAdditionalInfo += m_charCount * (sizeof(std::uint64_t) + sizeof(uint8_t));
+            return;
+        }
 
-            calculateCodeTable();
+        if (m_model == ORDER_0_MODEL)
+        {
+            appendLittleEndian(header, m_charCount, sizeof(uint16_t));
+            for (size_t i = 0; i != SIZE_OF_ARRAY; ++i)
+                if (m_codeTable.m_length[i] != 0)
+                {
+                    header.push_back((uint8_t) i);
+                    header.push_back(m_codeTable.m_length[i]);
+                }
+            return;
+        }
 
-            size_t index = (sizeof(uint8_t) + sizeof(std::uint64_t)) * m_charCount + sizeof(std::uint64_t);
+        size_t contextCount = 0;
+        for (size_t i = 0; i != SIZE_OF_ARRAY; ++i)
+        {
+            if (m_contextTables[i].m_maxLength != 0)
+                ++contextCount;
+        }
+        appendLittleEndian(header, contextCount, sizeof(uint16_t));
+
+        for (size_t context = 0; context != SIZE_OF_ARRAY; ++context)
+        {
+            const CodeTable& table = m_contextTables[context];
+            if (table.m_maxLength == 0)
+                continue;
+
+            size_t symbolCount = 0;
+            for (size_t i = 0; i != SIZE_OF_ARRAY; ++i)
+            {
+                if (table.m_length[i] != 0)
+                    ++symbolCount;
+            }
+            header.push_back((uint8_t) context);
+            header.push_back((uint8_t) (symbolCount - 1));
 
-            if (index + sizeof(std::uint64_t) >= length)
+            for (size_t i = 0; i != SIZE_OF_ARRAY; ++i)
+                if (table.m_length[i] != 0)
                 {
-                    throw HuffmanCodeException("Incorrect input file");
+                    header.push_back((uint8_t) i);
+                    header.push_back(table.m_length[i]);
                 }
-            m_bitsCount = *((std::uint64_t*)(buffer.data() + index));
-            m_sizeOfAdditionalInfo += sizeof(std::uint64_t);
-            index += sizeof(std::uint64_t);
-
+        }
+    }
 
-            size_t byteCount = m_bitsCount / BITS_IN_BYTE + (m_bitsCount % BITS_IN_BYTE != 0);
-            m_bits.resize(byteCount);
+    void HuffmanCode::writeBlocks(const uint8_t* data, size_t length, FileWriter& output)
+    {
+        BitWriter<FileWriter> writer(output);
+        for (size_t start = 0; start < length; start += m_containerBlockSize)
+        {
+            size_t end = start + std::min<size_t>(m_containerBlockSize, length - start);
+            BlockEntry entry;
+            entry.m_offset = output.written();
+            entry.m_crc = crc32c(0, data + start, end - start);
 
-            if (index + byteCount > length)
+            if (m_model == RANS_MODEL)
+            {
+                m_ransBuffer.resize(RansCoder::encodeBound(m_containerBlockSize));
+                size_t first = m_rans.encode(data + start, end - start, m_ransBuffer.data(), m_ransBuffer.size());
+                output.write(m_ransBuffer.data() + first, m_ransBuffer.size() - first);
+            }
+            else if (m_model == ORDER_1_MODEL)
+            {
+                const CodeTable* table = &m_contextTables[0];
+                for (size_t i = start; i < end; ++i)
                 {
-                    throw HuffmanCodeException("Incorrect input file");
+                    writer.write(table->m_code[data[i]], table->m_length[data[i]]);
+                    table = &m_contextTables[data[i]];
                 }
-            memcpy(m_bits.data(), &buffer[index], byteCount);
+            }
+            else
+            {
+                for (size_t i = start; i < end; ++i)
+                {
+                    writer.write(m_codeTable.m_code[data[i]], m_codeTable.m_length[data[i]]);
+                }
+            }
+            writer.flush();
+
+            entry.m_size = output.written() - entry.m_offset;
+            m_blocks.push_back(entry);
         }
     }
 
-    void HuffmanCode::clear()
+    void HuffmanCode::writeIndex(FileWriter& output)
     {
-        m_bits.clear();
-        delete m_headCharNode;
-        m_charCount = 0;
-        m_headCharNode = 0;
-        m_sizeOfAdditionalInfo = 0;
-        for (size_t i = 0; i != SIZE_OF_ARRAY; ++i)
+        uint64_t indexOffset = output.written();
+        std::vector<uint8_t> index;
+        index.reserve(m_blocks.size() * INDEX_ENTRY_SIZE + CONTAINER_FOOTER_SIZE);
+        for (size_t i = 0; i != m_blocks.size(); ++i)
         {
-            m_charFrequency[i] = 0;
-            m_codeTable[i].clear();
+            appendLittleEndian(index, m_blocks[i].m_offset, sizeof(uint64_t));
+            appendLittleEndian(index, m_blocks[i].m_size, sizeof(uint32_t));
+            appendLittleEndian(index, m_blocks[i].m_crc, sizeof(uint32_t));
         }
+        appendLittleEndian(index, indexOffset, sizeof(uint64_t));
+        appendLittleEndian(index, m_blocks.size(), sizeof(uint64_t));
+        appendLittleEndian(index, crc32c(0, index.data(), index.size()), sizeof(uint32_t));
+        index.insert(index.end(), INDEX_MAGIC, INDEX_MAGIC + MAGIC_SIZE);
+
+        output.write(index.data(), index.size());
+        m_sizeOfAdditionalInfo += index.size();
     }
 
-    void HuffmanCode::writeDecompressedFile(std::ostream& output)
+    size_t HuffmanCode::readCodeTable(const uint8_t* data, size_t length)
     {
-        size_t sizeOfDecompressedFile = 0;
-        if (m_charCount != 0)
+        if (length < sizeof(uint16_t))
+        {
+            throw HuffmanCodeException("Incorrect input file");
+        }
+        size_t count = loadLittleEndian(data, sizeof(uint16_t));
+        size_t index = sizeof(uint16_t);
+        if (count > SIZE_OF_ARRAY)
+        {
+            throw HuffmanCodeException("Incorrect input file");
+        }
+
+        if (m_model == ORDER_0_MODEL)
         {
-            size_t index = 0;
-            while (index < m_bitsCount)
+            m_charCount = count;
+            readCodeLengths(data, length, index, count, m_codeTable);
+            return index;
+        }
+
+        if (m_model == RANS_MODEL)
+        {
+            if (index + (sizeof(uint8_t) + sizeof(uint16_t)) * count > length)
+            {
+                throw HuffmanCodeException("Incorrect input file");
+            }
+            uint16_t frequency[SIZE_OF_ARRAY] = {};
+            for (size_t i = 0; i < count; ++i, index += sizeof(uint8_t) + sizeof(uint16_t))
             {
-                if (m_headCharNode == 0)
+                if (frequency[data[index]] != 0)
                 {
                     throw HuffmanCodeException("Incorrect input file");
                 }
-                m_headCharNode->recoveryByNode(index, m_bits, output);
-                ++sizeOfDecompressedFile;
-                if (m_charCount == 1)
-                    ++index;
+                frequency[data[index]] = loadLittleEndian(data + index + 1, sizeof(uint16_t));
             }
-            
-            m_bits.clear();
-            cout << m_bitsCount / BITS_IN_BYTE + (m_bitsCount % BITS_IN_BYTE != 0) << endl <<
-            sizeOfDecompressedFile << endl << m_sizeOfAdditionalInfo << endl;
+            if (count != 0 && !m_rans.setFrequencies(frequency))
+            {
+                throw HuffmanCodeException("Incorrect input file");
+            }
+            m_charCount = count;
+            return index;
         }
-        else
-            cout << 0 << endl << 0 << endl << sizeof(std::uint64_t) << endl;
-        
 
+        m_contextTables.resize(SIZE_OF_ARRAY);
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (index + 2 * sizeof(uint8_t) > length)
+            {
+                throw HuffmanCodeException("Incorrect input file");
+            }
+            CodeTable& table = m_contextTables[data[index]];
+            size_t symbolCount = data[index + 1] + 1;
+            index += 2 * sizeof(uint8_t);
+            if (table.m_maxLength != 0)
+            {
+                throw HuffmanCodeException("Incorrect input file");
+            }
+            readCodeLengths(data, length, index, symbolCount, table);
+        }
+        return index;
     }
 
-    void HuffmanCode::CharNode::toTable(std::string* codeTable, const std::string& code) const
+    void HuffmanCode::readCodeLengths(const uint8_t* data, size_t length, size_t& index, size_t symbolCount, CodeTable& table)
     {
-        if (this->one == 0 || this->zero == 0)
-            codeTable[this->m_char] = code;
-        if (this->one != 0)
-            this->one->toTable(codeTable, code + "1");
-        if (this->zero != 0)
-            this->zero->toTable(codeTable, code + "0");
+        if (index + 2 * sizeof(uint8_t) * symbolCount > length)
+        {
+            throw HuffmanCodeException("Incorrect input file");
+        }
+        for (size_t i = 0; i < symbolCount; ++i, index += 2 * sizeof(uint8_t))
+        {
+            uint8_t symbol = data[index];
+            if (data[index + 1] == 0 || table.m_length[symbol] != 0)
+            {
+                throw HuffmanCodeException("Incorrect input file");
+            }
+            table.m_length[symbol] = data[index + 1];
+        }
+        if (!table.assignCanonicalCodes())
+        {
+            throw HuffmanCodeException("Incorrect input file");
+        }
     }
 
-    void HuffmanCode::CharNode::recoveryByNode(size_t & index, std::vector<char> & m_bits, std::ostream& output) const
+    void HuffmanCode::readContainer(const uint8_t* data, size_t length)
     {
-        
-        if (this->one == 0 && this->zero == 0)
+        if (length < CONTAINER_HEADER_SIZE + sizeof(uint32_t) + CONTAINER_FOOTER_SIZE
+            || memcmp(data, CONTAINER_MAGIC, MAGIC_SIZE) != 0)
         {
-            char tempChar = this->m_char;
-            output.write(&tempChar, 1);
-            return;
+            throw HuffmanCodeException("Incorrect input file");
+        }
+        if (data[MAGIC_SIZE] != CONTAINER_VERSION)
+        {
+            throw HuffmanCodeException("Unsupported container version");
+        }
+        m_model = data[MAGIC_SIZE + 1];
+        if (m_model != ORDER_0_MODEL && m_model != ORDER_1_MODEL && m_model != RANS_MODEL)
+        {
+            throw HuffmanCodeException("Incorrect input file");
+        }
+        m_originalSize = loadLittleEndian(data + 8, sizeof(uint64_t));
+        m_containerBlockSize = loadLittleEndian(data + 16, sizeof(uint32_t));
+        uint64_t tableSize = loadLittleEndian(data + 20, sizeof(uint32_t));
+        if (m_containerBlockSize == 0 || m_containerBlockSize > MAX_BLOCK_SIZE
+            || tableSize > length - CONTAINER_HEADER_SIZE - sizeof(uint32_t) - CONTAINER_FOOTER_SIZE)
+        {
+            throw HuffmanCodeException("Incorrect input file");
+        }
+        size_t payloadStart = CONTAINER_HEADER_SIZE + tableSize;
+        if (crc32c(0, data, payloadStart) != loadLittleEndian(data + payloadStart, sizeof(uint32_t)))
+        {
+            throw HuffmanCodeException("Checksum mismatch in header");
         }
-        char tempChar = 1 << (BITS_IN_BYTE - 1 - index % BITS_IN_BYTE);
-        if ((m_bits[index / BITS_IN_BYTE] & tempChar ) != tempChar)
+        if (readCodeTable(data + CONTAINER_HEADER_SIZE, tableSize) != tableSize)
         {
-            if (this->zero != 0)
+            throw HuffmanCodeException("Incorrect input file");
+        }
+        payloadStart += sizeof(uint32_t);
+
+        const uint8_t* footer = data + length - CONTAINER_FOOTER_SIZE;
+        uint64_t indexOffset = loadLittleEndian(footer, sizeof(uint64_t));
+        uint64_t blockCount = loadLittleEndian(footer + 8, sizeof(uint64_t));
+        uint64_t expectedBlockCount = m_originalSize / m_containerBlockSize + (m_originalSize % m_containerBlockSize != 0);
+        if (memcmp(footer + CONTAINER_FOOTER_SIZE - MAGIC_SIZE, INDEX_MAGIC, MAGIC_SIZE) != 0
+            || blockCount != expectedBlockCount
+            || blockCount > (length - payloadStart) / INDEX_ENTRY_SIZE
+            || indexOffset < payloadStart
+            || indexOffset + blockCount * INDEX_ENTRY_SIZE + CONTAINER_FOOTER_SIZE != length)
+        {
+            throw HuffmanCodeException("Incorrect input file");
+        }
+        const uint8_t* index = data + indexOffset;
+        if (crc32c(0, index, length - indexOffset - sizeof(uint32_t) - MAGIC_SIZE)
+            != loadLittleEndian(footer + 16, sizeof(uint32_t)))
+        {
+            throw HuffmanCodeException("Checksum mismatch in block index");
+        }
+
+        m_blocks.resize(blockCount);
+        for (size_t i = 0; i != blockCount; ++i, index += INDEX_ENTRY_SIZE)
+        {
+            m_blocks[i].m_offset = loadLittleEndian(index, sizeof(uint64_t));
+            m_blocks[i].m_size = loadLittleEndian(index + 8, sizeof(uint32_t));
+            m_blocks[i].m_crc = loadLittleEndian(index + 12, sizeof(uint32_t));
+            if (m_blocks[i].m_offset < payloadStart || m_blocks[i].m_offset > indexOffset
+                || m_blocks[i].m_size > indexOffset - m_blocks[i].m_offset)
             {
-                this->zero->recoveryByNode(++index, m_bits, output);
+                throw HuffmanCodeException("Incorrect input file");
             }
-            else
+        }
+
+        m_container = data;
+        m_sizeOfAdditionalInfo = payloadStart + (length - indexOffset);
+        m_blockBuffer.resize(std::min<uint64_t>(m_containerBlockSize, m_originalSize));
+    }
+
+    size_t HuffmanCode::decodeBlock(size_t block)
+    {
+        const BlockEntry& entry = m_blocks[block];
+        size_t blockLength = std::min<uint64_t>(m_containerBlockSize, m_originalSize - (uint64_t)block * m_containerBlockSize);
+        uint8_t* output = m_blockBuffer.data();
+        if (m_model == RANS_MODEL)
+        {
+            if (m_charCount == 0 || !m_rans.decode(m_container + entry.m_offset, entry.m_size, output, blockLength))
             {
                 throw HuffmanCodeException("Incorrect input file");
-            }            
+            }
+            if (crc32c(0, output, blockLength) != entry.m_crc)
+            {
+                throw HuffmanCodeException("Checksum mismatch in block");
+            }
+            return blockLength;
+        }
+
+        BitReader reader(m_container + entry.m_offset, (uint64_t)entry.m_size * BITS_IN_BYTE);
+        if (m_model == ORDER_1_MODEL)
+        {
+            uint8_t context = 0;
+            for (size_t i = 0; i != blockLength; ++i)
+            {
+                context = m_contextTables[context].decode(reader);
+                output[i] = context;
+            }
         }
         else
         {
-            if (this->one != 0)
+            for (size_t i = 0; i != blockLength; ++i)
             {
-                this->one->recoveryByNode(++index, m_bits, output);
+                output[i] = m_codeTable.decode(reader);
             }
-            else
+        }
+
+        if (reader.position() > (uint64_t)entry.m_size * BITS_IN_BYTE)
+        {
+            throw HuffmanCodeException("Incorrect input file");
+        }
+        if (crc32c(0, output, blockLength) != entry.m_crc)
+        {
+            throw HuffmanCodeException("Checksum mismatch in block");
+        }
+        return blockLength;
+    }
+
+    void HuffmanCode::clear()
+    {
+        m_container = 0;
+        m_charCount = 0;
+        m_originalSize = 0;
+        m_sizeOfAdditionalInfo = 0;
+        m_blocks.clear();
+        m_codeTable.clear();
+        for (size_t i = 0; i != SIZE_OF_ARRAY; ++i)
+        {
+            m_charFrequency[i] = 0;
+        }
+        for (size_t i = 0; i != m_contextTables.size(); ++i)
+        {
+            m_contextTables[i].clear();
+        }
+    }
+
+    void HuffmanCode::CodeTable::clear()
+    {
+        memset(m_length, 0, sizeof(m_length));
+        memset(m_code, 0, sizeof(m_code));
+        m_maxLength = 0;
+    }
+
+    bool HuffmanCode::CodeTable::assignCanonicalCodes()
+    {
+        memset(m_lengthCount, 0, sizeof(m_lengthCount));
+        m_maxLength = 0;
+        for (size_t i = 0; i != SIZE_OF_ARRAY; ++i)
+        {
+            if (m_length[i] > MAX_CODE_LENGTH)
+                return false;
+            ++m_lengthCount[m_length[i]];
+            m_maxLength = std::max(m_maxLength, m_length[i]);
+        }
+
+        uint64_t code = 0;
+        uint16_t index = 0;
+        m_lengthCount[0] = 0;
+        for (size_t length = 1; length <= m_maxLength; ++length)
+        {
+            code = (code + m_lengthCount[length - 1]) << 1;
+            if (code + m_lengthCount[length] > (uint64_t(1) << length))
+                return false;
+            m_firstCode[length] = code;
+            m_firstIndex[length] = index;
+            index += m_lengthCount[length];
+        }
+
+        m_tableBits = std::min<uint8_t>(m_maxLength, DECODE_TABLE_BITS);
+        memset(m_decodeTable, 0, sizeof(m_decodeTable));
+
+        uint16_t next[MAX_CODE_LENGTH + 1];
+        memcpy(next, m_firstIndex, sizeof(next));
+        for (size_t i = 0; i != SIZE_OF_ARRAY; ++i)
+        {
+            uint8_t length = m_length[i];
+            if (length != 0)
             {
-                throw HuffmanCodeException("Incorrect input file");
+                m_code[i] = m_firstCode[length] + (next[length] - m_firstIndex[length]);
+                m_sortedSymbols[next[length]++] = i;
+                if (length <= m_tableBits)
+                {
+                    size_t first = m_code[i] << (m_tableBits - length);
+                    size_t last = first + (size_t(1) << (m_tableBits - length));
+                    for (size_t j = first; j != last; ++j)
+                    {
+                        m_decodeTable[j] = (length << BITS_IN_BYTE) | i;
+                    }
+                }
+            }
+        }
+        return true;
+    }
+
+    uint8_t HuffmanCode::CodeTable::decode(BitReader& reader) const
+    {
+        if (m_maxLength == 0)
+        {
+            throw HuffmanCodeException("Incorrect input file");
+        }
+        uint64_t window = reader.peek(m_maxLength);
+        uint16_t entry = m_decodeTable[window >> (m_maxLength - m_tableBits)];
+        if (entry != 0)
+        {
+            reader.skip(entry >> BITS_IN_BYTE);
+            return (uint8_t)entry;
+        }
+        for (size_t length = m_tableBits + 1; length <= m_maxLength; ++length)
+        {
+            uint64_t offset = (window >> (m_maxLength - length)) - m_firstCode[length];
+            if (offset < m_lengthCount[length])
+            {
+                reader.skip(length);
+                return m_sortedSymbols[m_firstIndex[length] + offset];
             }
         }
+        throw HuffmanCodeException("Incorrect input file");
+    }
 
+    HuffmanCode::Dictionary::Dictionary(const uint8_t* sample, size_t sampleSize, unsigned maxCodeLength)
+    {
+        uint64_t frequency[SIZE_OF_ARRAY] = {};
+        countBytesParallel(sample, sampleSize, frequency);
+        build(frequency, maxCodeLength);
     }
 
-    HuffmanCode::CharNode::~CharNode()
+    HuffmanCode::Dictionary::Dictionary(const uint64_t* frequency, unsigned maxCodeLength)
     {
-        delete zero;
-        delete one;
+        build(frequency, maxCodeLength);
+    }
+
+    void HuffmanCode::Dictionary::build(const uint64_t* frequency, unsigned maxCodeLength)
+    {
+        uint64_t smoothed[SIZE_OF_ARRAY];
+        for (size_t i = 0; i != SIZE_OF_ARRAY; ++i)
+        {
+            // keep the proportions of the sample but leave room for bytes it never had
+            smoothed[i] = frequency[i] * SIZE_OF_ARRAY + 1;
+        }
+
+        HuffmanCode builder;
+        builder.setMaxCodeLength(maxCodeLength);
+        builder.calculateCodeTable(smoothed, m_table);
+    }
+
+    HuffmanCode::Dictionary::Dictionary(const uint8_t* codeLengths)
+    {
+        m_table.clear();
+        memcpy(m_table.m_length, codeLengths, SIZE_OF_ARRAY);
+        for (size_t i = 0; i != SIZE_OF_ARRAY; ++i)
+        {
+            if (codeLengths[i] == 0)
+                throw HuffmanCodeException("Dictionary must give every byte a code");
+        }
+        if (!m_table.assignCanonicalCodes())
+            throw HuffmanCodeException("Incorrect dictionary");
+    }
+
+    const uint8_t* HuffmanCode::Dictionary::codeLengths() const
+    {
+        return m_table.m_length;
+    }
+
+    size_t HuffmanCode::Dictionary::compressBound(size_t inputSize) const
+    {
+        return MAX_VARINT_SIZE + inputSize / BITS_IN_BYTE * m_table.m_maxLength + m_table.m_maxLength;
     }
-    
-    HuffmanCode::CharNode::CharNode(uint8_t newChar, std::uint64_t frequency, CharNode* zero, CharNode* one)
-		:m_char(newChar)
-		,m_frequency(frequency)
-		,zero(zero)
-		,one(one)
-    {	}
 
     HuffmanCode::HuffmanCodeException::HuffmanCodeException(const char* text)
         :m_text(text)
@@ -3,6 +3,9 @@
 #include <vector>
 #include <exception>
 #include <cstdint>
+#include "file_io.hpp"
+#include "bit_stream.hpp"
+#include "rans.hpp"
 
 class HuffmanCode{
 public:
@@ -10,6 +13,35 @@ public:
     ~HuffmanCode();
     void compress(const std::string& inputFile, const std::string& outputFile);
     void unpack(const std::string& inputFile, const std::string& outputFile);
+    // Decodes only the blocks that cover [offset, offset + length) of the original file.
+    void extract(const std::string& inputFile, const std::string& outputFile, uint64_t offset, uint64_t length);
+    void setMaxCodeLength(unsigned maxCodeLength);
+    // Codes every byte with a table chosen by the byte before it.
+    void setContextModeling(bool enabled);
+    // Codes the container blocks with interleaved rANS instead of Huffman codes (order-0 only).
+    void setAnsBackend(bool enabled);
+    // Granularity of random access; each block is coded and checksummed on its own.
+    void setBlockSize(uint32_t blockSize);
+
+    // Adds the byte histogram of `data` to `frequency` (256 counters).
+    static void countFrequency(const uint8_t* data, size_t length, uint64_t* frequency);
+    // Builds the order-0 code table compress() would build for this histogram.
+    void buildCodeTable(const uint64_t* frequency);
+    // Code with the table from the last buildCodeTable(): the bare bitstream, no size or table.
+    // outputCapacity of compressBound(inputSize) is enough for encode(); decode() reads outputSize symbols.
+    size_t encode(const uint8_t* input, size_t inputSize, uint8_t* output, size_t outputCapacity) const;
+    size_t decode(const uint8_t* input, size_t inputSize, uint8_t* output, size_t outputSize) const;
+
+    // Buffer-to-buffer coding of one message with an order-0 table stored in front of it.
+    // Tables live in the object, so reusing one HuffmanCode per thread codes messages without allocating.
+    // Both return the number of bytes written and throw if `output` is too small.
+    class Dictionary;
+    static size_t compressBound(size_t inputSize);
+    size_t compress(const uint8_t* input, size_t inputSize, uint8_t* output, size_t outputCapacity);
+    size_t unpack(const uint8_t* input, size_t inputSize, uint8_t* output, size_t outputCapacity);
+    // The same with a shared table: no frequency pass and no table in the message.
+    size_t compress(const uint8_t* input, size_t inputSize, uint8_t* output, size_t outputCapacity, const Dictionary& dictionary) const;
+    size_t unpack(const uint8_t* input, size_t inputSize, uint8_t* output, size_t outputCapacity, const Dictionary& dictionary) const;
     class HuffmanCodeException: public std::exception
     {
     public:
@@ -19,36 +51,124 @@ public:
         const char* m_text;
     };
 private:
+    // Longest code BitReader::peek can return in one window.
+    static unsigned const MAX_CODE_LENGTH = 56;
+    // Enough to give each of the 256 byte values a code.
+    static unsigned const MIN_CODE_LENGTH_LIMIT = 8;
+    static unsigned const DECODE_TABLE_BITS = 12;
+    static uint8_t const ORDER_0_MODEL = 0;
+    static uint8_t const ORDER_1_MODEL = 1;
+    // code table: (symbol, 14-bit frequency (2)) pairs instead of code lengths
+    static uint8_t const RANS_MODEL = 2;
+
+    // Container layout, little-endian:
+    //   header  magic "HUFC", version, model, 2 reserved bytes, original size (8),
+    //           block size (4), table size (4), code table, CRC32C of all of the above (4)
+    //   blocks  independently coded bitstreams, each padded to a byte; for RANS_MODEL the four
+    //           final rANS states (4 each) followed by the renormalization bytes
+    //   index   per block: offset (8), size (4), CRC32C of the decoded block (4)
+    //   footer  index offset (8), block count (8), CRC32C of index and footer so far (4), magic "HUFI"
+    static size_t const MAGIC_SIZE = 4;
+    static uint8_t const CONTAINER_MAGIC[MAGIC_SIZE];
+    static uint8_t const INDEX_MAGIC[MAGIC_SIZE];
+    static uint8_t const CONTAINER_VERSION = 1;
+    static size_t const CONTAINER_HEADER_SIZE = 24;
+    static size_t const INDEX_ENTRY_SIZE = 16;
+    static size_t const CONTAINER_FOOTER_SIZE = 24;
+    static uint32_t const MAX_BLOCK_SIZE = 1 << 30;
+
+    struct BlockEntry
+    {
+        uint64_t m_offset;
+        uint32_t m_size;
+        uint32_t m_crc;
+    };
+
     struct CharNode
     {
-        uint8_t m_char;
         uint64_t m_frequency;
-        CharNode* zero;
-        CharNode* one;
-        CharNode(uint8_t newChar, uint64_t frequency, CharNode* zero = nullptr, CharNode* one = nullptr);
-        void toTable(std::string* codeTable, const std::string & code) const;
-        void recoveryByNode(size_t & index, std::vector<char> & m_bits, std::ostream& output) const;
-        ~CharNode();
+        uint16_t m_parent;
+        uint16_t m_depth;
+        uint8_t m_char;
     };
 
-    struct CompCharNodePointer
+    // Ties are broken by symbol, so the order (and the code) does not depend on the sort used.
+    struct CompCharNode
     {
-        bool operator()(CharNode* first, CharNode* second)
+        bool operator()(const CharNode& first, const CharNode& second) const
         {
-            return (first->m_frequency > second->m_frequency);
+            return first.m_frequency < second.m_frequency
+                || (first.m_frequency == second.m_frequency && first.m_char < second.m_char);
         }
     };
+
+    struct CodeTable
+    {
+        uint8_t m_length[256];
+        uint64_t m_code[256];
+        uint8_t m_maxLength;
+        uint16_t m_lengthCount[MAX_CODE_LENGTH + 1];
+        uint16_t m_firstIndex[MAX_CODE_LENGTH + 1];
+        uint64_t m_firstCode[MAX_CODE_LENGTH + 1];
+        uint8_t m_sortedSymbols[256];
+        uint8_t m_tableBits;
+        // length << 8 | symbol for codes of at most m_tableBits bits, 0 for longer ones
+        uint16_t m_decodeTable[1 << DECODE_TABLE_BITS];
+        void clear();
+        bool assignCanonicalCodes();
+        uint8_t decode(BitReader& reader) const;
+    };
+
     std::uint64_t m_charFrequency[256];
-    CharNode* m_headCharNode;
-    std::string m_codeTable[256];
+    CharNode m_nodes[2 * 256 - 1];
+    CodeTable m_codeTable;
+    unsigned m_maxCodeLength;
+    bool m_contextModeling;
+    bool m_ansBackend;
+    RansCoder m_rans;
+    std::vector<uint8_t> m_ransBuffer;
+    uint8_t m_model;
+    std::vector<uint64_t> m_contextFrequency;
+    std::vector<CodeTable> m_contextTables;
     std::uint64_t m_charCount;
-    std::vector<char> m_bits;
-    uint64_t m_bitsCount;
+    uint32_t m_blockSize;
+    uint32_t m_containerBlockSize;
+    uint64_t m_originalSize;
+    const uint8_t* m_container;
+    std::vector<BlockEntry> m_blocks;
+    std::vector<uint8_t> m_blockBuffer;
     uint64_t m_sizeOfAdditionalInfo;
-    void countCharFrequency(std::istream& input);
-    void calculateCodeTable();
-    void writeCodeTable(std::istream& input, std::ostream& output);
-    void readCodeTable(std::istream& input);
+    void countCharFrequency(const uint8_t* data, size_t length);
+    void countContextFrequency(const uint8_t* data, size_t length);
+    void calculateCodeTable(const uint64_t* frequency, CodeTable& table);
+    void limitCodeLengths(size_t leafCount);
+    void writeCodeTable(std::vector<uint8_t>& header) const;
+    void writeBlocks(const uint8_t* data, size_t length, FileWriter& output);
+    void writeIndex(FileWriter& output);
+    size_t readCodeTable(const uint8_t* data, size_t length);
+    void readCodeLengths(const uint8_t* data, size_t length, size_t& index, size_t symbolCount, CodeTable& table);
+    void readContainer(const uint8_t* data, size_t length);
+    size_t decodeBlock(size_t block);
     void clear();
-    void writeDecompressedFile(std::ostream& output);
+    void encodeSymbols(const uint8_t* data, size_t length, const CodeTable& table, BitWriter<MemoryWriter>& writer) const;
+    size_t decodeMessage(const uint8_t* input, size_t inputSize, size_t index, uint64_t outputSize, uint8_t* output, size_t outputCapacity, const CodeTable& table) const;
+};
+
+// A code table built once, from sample data or from saved code lengths, and shared read-only
+// between any number of HuffmanCode objects and threads. Every byte value gets a code.
+class HuffmanCode::Dictionary
+{
+public:
+    static unsigned const DEFAULT_MAX_CODE_LENGTH = 12;
+    Dictionary(const uint8_t* sample, size_t sampleSize, unsigned maxCodeLength = DEFAULT_MAX_CODE_LENGTH);
+    // from a histogram as filled by HuffmanCode::countFrequency
+    explicit Dictionary(const uint64_t* frequency, unsigned maxCodeLength = DEFAULT_MAX_CODE_LENGTH);
+    explicit Dictionary(const uint8_t* codeLengths);
+    // 256 code lengths, enough to rebuild the dictionary later
+    const uint8_t* codeLengths() const;
+    size_t compressBound(size_t inputSize) const;
+private:
+    CodeTable m_table;
+    void build(const uint64_t* frequency, unsigned maxCodeLength);
+    friend class HuffmanCode;
 };
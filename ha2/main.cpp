@@ -1,23 +1,35 @@
 #include <iostream>
 #include <fstream>
 #include <cstring>
+#include <cstdlib>
 #include <string>
 #include "huffman.hpp"
 
 
+static unsigned long long parseNumber(const char* text, const char* errorText)
+{
+	char* end = nullptr;
+	unsigned long long value = std::strtoull(text, &end, 10);
+	if (*text == '\0' || *text == '-' || *end != '\0')
+	{
+		throw HuffmanCode::HuffmanCodeException(errorText);
+	}
+	return value;
+}
 
 int main(int argc, char* argv[])
 {
 	std::ios_base::sync_with_stdio(0);
     try{
         HuffmanCode s;
-        if (argc != 6)
+        if (argc < 6)
         {
             throw HuffmanCode::HuffmanCodeException("Incorrect number of arguments in command line!");
         }
 
         bool isCompressing = false;
-        std::string const COMPRESS_FLAG("-c"), UNCOMPRESS_FLAG("-u");
+        bool isExtracting = false;
+        std::string const COMPRESS_FLAG("-c"), UNCOMPRESS_FLAG("-u"), EXTRACT_FLAG("-x");
         if (argv[1] == COMPRESS_FLAG)
         {
 			isCompressing = true;
@@ -26,6 +38,9 @@ int main(int argc, char* argv[])
 			if (argv[1] == UNCOMPRESS_FLAG)
 			{
 				isCompressing = false;
+			} else if (argv[1] == EXTRACT_FLAG)
+			{
+				isExtracting = true;
 			} else
 			{
 				throw HuffmanCode::HuffmanCodeException("Incorrect first argument in command line!");
@@ -36,8 +51,19 @@ int main(int argc, char* argv[])
         std::string inputFile = "";
         std::string outputFile = "";
 		std::string const INPUT_FILE_LONG_FLAG("--file"), INPUT_FILE_SHORT_FLAG("-f"), OUTPUT_FILE_LONG_FLAG("--output"), OUTPUT_FILE_SHORT_FLAG("-o");
-        for (size_t i = 2; i < 5; ++i)
+		std::string const MAX_LENGTH_LONG_FLAG("--max-length"), MAX_LENGTH_SHORT_FLAG("-l");
+		std::string const OFFSET_LONG_FLAG("--offset"), OFFSET_SHORT_FLAG("-s"), LENGTH_LONG_FLAG("--length"), LENGTH_SHORT_FLAG("-n");
+		unsigned long long offset = 0;
+		unsigned long long length = 0;
+		bool hasLength = false;
+		std::string const ENTROPY_LONG_FLAG("--entropy"), ENTROPY_SHORT_FLAG("-e"), HUFFMAN_ENTROPY("huffman"), ANS_ENTROPY("ans");
+		std::string const MODEL_LONG_FLAG("--model"), MODEL_SHORT_FLAG("-m"), ORDER_0_MODEL("order0"), ORDER_1_MODEL("order1");
+        for (int i = 2; i < argc; ++i)
         {
+			if (i + 1 == argc)
+			{
+				throw HuffmanCode::HuffmanCodeException("Missing value of the last argument in command line!");
+			}
 			if (argv[i] == INPUT_FILE_SHORT_FLAG || argv[i] == INPUT_FILE_LONG_FLAG)
 			{
 				if (inputFile.size() != 0)
@@ -47,26 +73,73 @@ int main(int argc, char* argv[])
 				++i;
 				inputFile = argv[i];
 			}
-			else 
+			else if (argv[i] == OUTPUT_FILE_LONG_FLAG || argv[i] == OUTPUT_FILE_SHORT_FLAG)
 			{
-				if (argv[i] == OUTPUT_FILE_LONG_FLAG || argv[i] == OUTPUT_FILE_SHORT_FLAG)
+				if (outputFile.size() != 0)
 				{
-					if (outputFile.size() != 0)
-					{
-						throw HuffmanCode::HuffmanCodeException("Incorrect output file arguments in command line!");
-					}
-					++i;
-					outputFile = argv[i];
+					throw HuffmanCode::HuffmanCodeException("Incorrect output file arguments in command line!");
 				}
-				else
+				++i;
+				outputFile = argv[i];
+			}
+			else if (argv[i] == MAX_LENGTH_LONG_FLAG || argv[i] == MAX_LENGTH_SHORT_FLAG)
+			{
+				++i;
+				unsigned long long maxLength = parseNumber(argv[i], "Incorrect maximum code length in command line!");
+				if (maxLength > 64)
 				{
-					throw HuffmanCode::HuffmanCodeException("Incorrect input and output file arguments in command line!");
+					throw HuffmanCode::HuffmanCodeException("Incorrect maximum code length in command line!");
 				}
-			} 
+				s.setMaxCodeLength(maxLength);
+			}
+			else if (argv[i] == OFFSET_LONG_FLAG || argv[i] == OFFSET_SHORT_FLAG)
+			{
+				++i;
+				offset = parseNumber(argv[i], "Incorrect offset in command line!");
+			}
+			else if (argv[i] == LENGTH_LONG_FLAG || argv[i] == LENGTH_SHORT_FLAG)
+			{
+				++i;
+				length = parseNumber(argv[i], "Incorrect length in command line!");
+				hasLength = true;
+			}
+			else if (argv[i] == MODEL_LONG_FLAG || argv[i] == MODEL_SHORT_FLAG)
+			{
+				++i;
+				if (argv[i] != ORDER_0_MODEL && argv[i] != ORDER_1_MODEL)
+				{
+					throw HuffmanCode::HuffmanCodeException("Incorrect model in command line!");
+				}
+				s.setContextModeling(argv[i] == ORDER_1_MODEL);
+			}
+			else if (argv[i] == ENTROPY_LONG_FLAG || argv[i] == ENTROPY_SHORT_FLAG)
+			{
+				++i;
+				if (argv[i] != HUFFMAN_ENTROPY && argv[i] != ANS_ENTROPY)
+				{
+					throw HuffmanCode::HuffmanCodeException("Incorrect entropy coder in command line!");
+				}
+				s.setAnsBackend(argv[i] == ANS_ENTROPY);
+			}
+			else
+			{
+				throw HuffmanCode::HuffmanCodeException("Incorrect input and output file arguments in command line!");
+			}
         }    
+        if (inputFile.size() == 0 || outputFile.size() == 0)
+        {
+            throw HuffmanCode::HuffmanCodeException("Incorrect input and output file arguments in command line!");
+        }
+
+        if (isExtracting && !hasLength)
+        {
+            throw HuffmanCode::HuffmanCodeException("Extraction needs a length in command line!");
+        }
 
         if (isCompressing)
             s.compress(inputFile, outputFile);
+        else if (isExtracting)
+            s.extract(inputFile, outputFile, offset, length);
         else
             s.unpack(inputFile, outputFile);
 
@@ -0,0 +1,185 @@
+#include <cstring>
+#include "rans.hpp"
+
+static int const SIZE_OF_ARRAY = 256;
+
+static int const BITS_IN_BYTE = 8;
+
+    RansCoder::RansCoder()
+    {
+        memset(m_frequency, 0, sizeof(m_frequency));
+        memset(m_symbolOfSlot, 0, sizeof(m_symbolOfSlot));
+        buildTables();
+    }
+
+    void RansCoder::normalize(const std::uint64_t* frequency)
+    {
+        std::uint64_t total = 0;
+        for (size_t i = 0; i != SIZE_OF_ARRAY; ++i)
+            total += frequency[i];
+
+        memset(m_frequency, 0, sizeof(m_frequency));
+        if (total == 0)
+        {
+            buildTables();
+            return;
+        }
+
+        std::int64_t sum = 0;
+        size_t largest = 0;
+        for (size_t i = 0; i != SIZE_OF_ARRAY; ++i)
+        {
+            if (frequency[i] == 0)
+                continue;
+            std::uint64_t scaled = (std::uint64_t)((long double)frequency[i] * PROBABILITY_SCALE / total);
+            m_frequency[i] = scaled == 0 ? 1 : (std::uint16_t)scaled;
+            sum += m_frequency[i];
+            if (frequency[i] > frequency[largest])
+                largest = i;
+        }
+
+        // rounding error goes to the most frequent byte, where it costs the least
+        std::int64_t error = (std::int64_t)PROBABILITY_SCALE - sum;
+        if (error >= 0 || m_frequency[largest] + error >= 1)
+        {
+            m_frequency[largest] += error;
+        }
+        else
+        {
+            while (error != 0)
+            {
+                size_t richest = 0;
+                for (size_t i = 1; i != SIZE_OF_ARRAY; ++i)
+                {
+                    if (m_frequency[i] > m_frequency[richest])
+                        richest = i;
+                }
+                --m_frequency[richest];
+                ++error;
+            }
+        }
+        buildTables();
+    }
+
+    bool RansCoder::setFrequencies(const std::uint16_t* frequency)
+    {
+        std::uint32_t sum = 0;
+        for (size_t i = 0; i != SIZE_OF_ARRAY; ++i)
+            sum += frequency[i];
+        if (sum != PROBABILITY_SCALE)
+            return false;
+        memcpy(m_frequency, frequency, sizeof(m_frequency));
+        buildTables();
+        return true;
+    }
+
+    const std::uint16_t* RansCoder::frequencies() const
+    {
+        return m_frequency;
+    }
+
+    void RansCoder::buildTables()
+    {
+        std::uint32_t start = 0;
+        for (size_t i = 0; i != SIZE_OF_ARRAY; ++i)
+        {
+            m_start[i] = start;
+            if (m_frequency[i] != 0)
+                memset(m_symbolOfSlot + start, (int)i, m_frequency[i]);
+            start += m_frequency[i];
+        }
+    }
+
+    std::size_t RansCoder::encodeBound(std::size_t length)
+    {
+        // a symbol of frequency 1 costs PROBABILITY_BITS bits, rounded up to whole renormalization bytes
+        return length * ((PROBABILITY_BITS + BITS_IN_BYTE - 1) / BITS_IN_BYTE) + STATE_COUNT * sizeof(std::uint32_t);
+    }
+
+    std::size_t RansCoder::encode(const std::uint8_t* data, std::size_t length, std::uint8_t* buffer, std::size_t bufferSize) const
+    {
+        std::uint32_t states[STATE_COUNT];
+        for (size_t i = 0; i != STATE_COUNT; ++i)
+            states[i] = LOWER_BOUND;
+
+        // rANS is last in, first out: code backwards so that the decoder runs forwards
+        std::uint8_t* position = buffer + bufferSize;
+        for (size_t i = length; i-- != 0; )
+        {
+            std::uint32_t& state = states[i % STATE_COUNT];
+            std::uint32_t frequency = m_frequency[data[i]];
+            std::uint32_t limit = ((LOWER_BOUND >> PROBABILITY_BITS) << BITS_IN_BYTE) * frequency;
+            while (state >= limit)
+            {
+                *--position = (std::uint8_t)state;
+                state >>= BITS_IN_BYTE;
+            }
+            state = ((state / frequency) << PROBABILITY_BITS) + (state % frequency) + m_start[data[i]];
+        }
+
+        for (size_t i = STATE_COUNT; i-- != 0; )
+        {
+            position -= sizeof(std::uint32_t);
+            for (size_t j = 0; j != sizeof(std::uint32_t); ++j)
+                position[j] = (std::uint8_t)(states[i] >> (BITS_IN_BYTE * j));
+        }
+        return position - buffer;
+    }
+
+    bool RansCoder::decode(const std::uint8_t* input, std::size_t inputSize, std::uint8_t* output, std::size_t length) const
+    {
+        if (inputSize < STATE_COUNT * sizeof(std::uint32_t))
+            return false;
+        const std::uint8_t* end = input + inputSize;
+        std::uint32_t states[STATE_COUNT];
+        for (size_t i = 0; i != STATE_COUNT; ++i)
+        {
+            states[i] = 0;
+            for (size_t j = sizeof(std::uint32_t); j-- != 0; )
+                states[i] = (states[i] << BITS_IN_BYTE) | input[j];
+            input += sizeof(std::uint32_t);
+            // the encoder keeps every state in [LOWER_BOUND, LOWER_BOUND << 8)
+            if (states[i] < LOWER_BOUND || states[i] >= (std::uint64_t)LOWER_BOUND << BITS_IN_BYTE)
+                return false;
+        }
+
+        std::size_t i = 0;
+        // a group of STATE_COUNT symbols reads at most this many bytes, so it needs no bounds checks
+        std::size_t const groupBytes = STATE_COUNT * ((PROBABILITY_BITS + BITS_IN_BYTE - 1) / BITS_IN_BYTE);
+        for (; i + STATE_COUNT <= length && (std::size_t)(end - input) >= groupBytes; i += STATE_COUNT)
+        {
+            for (size_t j = 0; j != STATE_COUNT; ++j)
+            {
+                std::uint32_t& state = states[j];
+                std::uint32_t slot = state & (PROBABILITY_SCALE - 1);
+                std::uint8_t symbol = m_symbolOfSlot[slot];
+                state = m_frequency[symbol] * (state >> PROBABILITY_BITS) + slot - m_start[symbol];
+                while (state < LOWER_BOUND)
+                    state = (state << BITS_IN_BYTE) | *input++;
+                output[i + j] = symbol;
+            }
+        }
+        for (; i != length; ++i)
+        {
+            std::uint32_t& state = states[i % STATE_COUNT];
+            std::uint32_t slot = state & (PROBABILITY_SCALE - 1);
+            std::uint8_t symbol = m_symbolOfSlot[slot];
+            if (m_frequency[symbol] == 0)
+                return false;
+            state = m_frequency[symbol] * (state >> PROBABILITY_BITS) + slot - m_start[symbol];
+            while (state < LOWER_BOUND)
+            {
+                if (input == end)
+                    return false;
+                state = (state << BITS_IN_BYTE) | *input++;
+            }
+            output[i] = symbol;
+        }
+
+        for (size_t j = 0; j != STATE_COUNT; ++j)
+        {
+            if (states[j] != LOWER_BOUND)
+                return false;
+        }
+        return input == end;
+    }
@@ -0,0 +1,33 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Static order-0 range ANS with byte-wise renormalization and four interleaved states,
+// decoded through a slot -> symbol table of 1 << PROBABILITY_BITS entries.
+class RansCoder
+{
+public:
+    static unsigned const PROBABILITY_BITS = 14;
+    static std::uint32_t const PROBABILITY_SCALE = 1 << PROBABILITY_BITS;
+
+    RansCoder();
+    // Scales a byte histogram to frequencies summing to PROBABILITY_SCALE; every used byte keeps at least 1.
+    void normalize(const std::uint64_t* frequency);
+    // Takes frequencies as stored in a file; false if they do not sum to PROBABILITY_SCALE.
+    bool setFrequencies(const std::uint16_t* frequency);
+    const std::uint16_t* frequencies() const;
+    static std::size_t encodeBound(std::size_t length);
+    // Codes `data` into the tail of `buffer` (at least encodeBound(length) bytes) and returns the offset of the first byte.
+    std::size_t encode(const std::uint8_t* data, std::size_t length, std::uint8_t* buffer, std::size_t bufferSize) const;
+    // False if the input is not a stream of exactly `length` symbols.
+    bool decode(const std::uint8_t* input, std::size_t inputSize, std::uint8_t* output, std::size_t length) const;
+private:
+    static unsigned const STATE_COUNT = 4;
+    static std::uint32_t const LOWER_BOUND = 1 << 23;
+
+    std::uint16_t m_frequency[256];
+    std::uint16_t m_start[256];
+    std::uint8_t m_symbolOfSlot[PROBABILITY_SCALE];
+    void buildTables();
+};
@@ -0,0 +1,336 @@
+#include <iostream>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <sys/resource.h>
+#include "linked_ptr.hpp"
+
+// Cost of linked_ptr next to std::shared_ptr and std::unique_ptr, printed as JSON:
+//   bench [--quick]
+// Every operation is repeated until it has run for MIN_PHASE_SECONDS and the fastest run is reported.
+// Sections:
+//   ownerships  create, copy, use_count and destroy for each ownership of linked_ptr
+//   rings       copy, reset, swap, move and use_count with every object held by ring_size owners
+//   growth      std::vector growth by moving owners in, per element
+//   threads     copy and drop of owners of one object from several threads at once
+
+static double const MIN_PHASE_SECONDS = 0.2;
+
+static size_t const MIN_PHASE_RUNS = 3;
+
+static size_t const OBJECTS = 1 << 16;
+
+static size_t const QUICK_OBJECTS = 1 << 12;
+
+static size_t const RING_SIZES[] = { 1, 10, 100, 1000 };
+
+static size_t const GROWTH_SIZES[] = { 1000, 100000 };
+
+static size_t const THREAD_COUNTS[] = { 1, 2, 4 };
+
+static size_t const THREAD_OPERATIONS = 1 << 18;
+
+static size_t const QUICK_THREAD_OPERATIONS = 1 << 14;
+
+struct RingObject
+{
+    long value;
+    explicit RingObject(long value) : value(value) {}
+};
+
+struct IntrusiveObject : smart_ptr::linked_counter<>
+{
+    long value;
+    explicit IntrusiveObject(long value) : value(value) {}
+};
+
+struct CountedObject
+{
+    long value;
+    explicit CountedObject(long value) : value(value) {}
+};
+
+namespace smart_ptr
+{
+    template <>
+    struct linked_traits<IntrusiveObject>
+    {
+        typedef intrusive_ownership ownership;
+    };
+
+    template <>
+    struct linked_traits<CountedObject>
+    {
+        typedef counted_ownership ownership;
+    };
+}
+
+typedef smart_ptr::linked_ptr<RingObject> RingPtr;
+typedef smart_ptr::linked_ptr<RingObject, smart_ptr::multi_threaded> SharedRingPtr;
+typedef smart_ptr::linked_ptr<CountedObject, smart_ptr::multi_threaded> SharedCountedPtr;
+
+    // prepare() runs before every timed run of phase() and is not counted.
+    template <class Prepare, class Phase>
+    static double fastestSeconds(Prepare prepare, Phase phase)
+    {
+        double best = 1e30;
+        double total = 0;
+        for (size_t runs = 0; runs < MIN_PHASE_RUNS || total < MIN_PHASE_SECONDS; ++runs)
+        {
+            prepare();
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            phase();
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            best = std::min(best, seconds);
+            total += seconds;
+        }
+        return best;
+    }
+
+    template <class Phase>
+    static double fastestSeconds(Phase phase)
+    {
+        return fastestSeconds([]() {}, phase);
+    }
+
+    // Makes the compiler assume memory was read and written here, so stores it could
+    // otherwise prove pointless (moving an owner out and straight back) are kept.
+    static inline void clobberMemory()
+    {
+        asm volatile("" : : : "memory");
+    }
+
+    static double nanosecondsPerOperation(size_t operations, double seconds)
+    {
+        return seconds * 1e9 / operations;
+    }
+
+    static const char* separator(bool& isFirst)
+    {
+        const char* result = isFirst ? "" : ",\n";
+        isFirst = false;
+        return result;
+    }
+
+    // Pointer is the smart pointer under test, Create(i) makes a new owner of a fresh object.
+    template <class Pointer, class Create>
+    static void runOwnership(const std::string& name, size_t objects, Create create, bool& isFirst)
+    {
+        std::vector<Pointer> owners(objects);
+        std::vector<Pointer> copies(objects);
+
+        double createSeconds = fastestSeconds([&]() {
+            for (size_t i = 0; i != objects; ++i)
+                owners[i] = create(i);
+        });
+        double copySeconds = fastestSeconds([&]() {
+            for (size_t i = 0; i != objects; ++i)
+                copies[i] = owners[i];
+            for (size_t i = 0; i != objects; ++i)
+                copies[i].reset();
+        });
+        long useCount = 0;
+        double useCountSeconds = fastestSeconds([&]() {
+            for (size_t i = 0; i != objects; ++i)
+                useCount += owners[i].use_count();
+        });
+        double destroySeconds = fastestSeconds([&]() {
+            for (size_t i = 0; i != objects; ++i)
+                owners[i] = create(i);
+        }, [&]() {
+            for (size_t i = 0; i != objects; ++i)
+                owners[i].reset();
+        });
+
+        std::cout << separator(isFirst) << "    {\"pointer\": \"" << name << "\", \"objects\": " << objects
+            << ", \"size\": " << sizeof(Pointer)
+            << ", \"create_ns\": " << nanosecondsPerOperation(objects, createSeconds)
+            << ", \"copy_and_drop_ns\": " << nanosecondsPerOperation(objects, copySeconds)
+            << ", \"use_count_ns\": " << nanosecondsPerOperation(objects, useCountSeconds)
+            << ", \"destroy_ns\": " << nanosecondsPerOperation(objects, destroySeconds)
+            << ", \"checksum\": " << useCount % 2 << "}";
+    }
+
+    // Every object is held by ringSize owners, kept together in `first` and `second`;
+    // the measured operations add, remove or exchange one owner of each ring.
+    template <class Pointer, class Create>
+    static void runRing(const std::string& name, size_t objects, size_t ringSize, Create create, bool& isFirst)
+    {
+        size_t const rings = std::max<size_t>(objects / ringSize, 1);
+        size_t const owners = rings * ringSize;
+        std::vector<Pointer> first(owners);
+        std::vector<Pointer> second(owners);
+        for (size_t i = 0; i != rings; ++i)
+        {
+            first[i * ringSize] = create(i);
+            second[i * ringSize] = create(rings + i);
+            for (size_t j = 1; j != ringSize; ++j)
+            {
+                first[i * ringSize + j] = first[i * ringSize];
+                second[i * ringSize + j] = second[i * ringSize];
+            }
+        }
+
+        std::vector<Pointer> copies(owners);
+        double copySeconds = fastestSeconds([&]() {
+            for (size_t i = 0; i != owners; ++i)
+                copies[i].reset();
+        }, [&]() {
+            for (size_t i = 0; i != owners; ++i)
+                copies[i] = first[i];
+        });
+        double resetSeconds = fastestSeconds([&]() {
+            for (size_t i = 0; i != owners; ++i)
+                copies[i] = first[i];
+        }, [&]() {
+            for (size_t i = 0; i != owners; ++i)
+                copies[i].reset();
+        });
+        double swapSeconds = fastestSeconds([&]() {
+            for (size_t i = 0; i != owners; ++i)
+                first[i].swap(second[i]);
+        });
+        size_t movedCount = 0;
+        double moveSeconds = fastestSeconds([&]() {
+            for (size_t i = 0; i != owners; ++i)
+            {
+                Pointer moved(std::move(first[i]));
+                clobberMemory();
+                movedCount += (moved.get() != nullptr);
+                first[i] = std::move(moved);
+            }
+        });
+        long useCount = 0;
+        size_t const useCountOwners = std::min<size_t>(owners, 1 << 12);
+        double useCountSeconds = fastestSeconds([&]() {
+            for (size_t i = 0; i != useCountOwners; ++i)
+                useCount += first[i].use_count();
+        });
+
+        std::cout << separator(isFirst) << "    {\"pointer\": \"" << name << "\", \"ring_size\": " << ringSize
+            << ", \"owners\": " << owners
+            << ", \"copy_ns\": " << nanosecondsPerOperation(owners, copySeconds)
+            << ", \"reset_ns\": " << nanosecondsPerOperation(owners, resetSeconds)
+            << ", \"swap_ns\": " << nanosecondsPerOperation(owners, swapSeconds)
+            << ", \"move_there_and_back_ns\": " << nanosecondsPerOperation(owners, moveSeconds)
+            << ", \"use_count_ns\": " << nanosecondsPerOperation(useCountOwners, useCountSeconds)
+            << ", \"checksum\": " << (useCount + movedCount) % 2 << "}";
+    }
+
+    // Moves `elements` owners into a vector that grows from empty, then back out.
+    template <class Pointer, class Create>
+    static void runGrowth(const std::string& name, size_t elements, Create create, bool& isFirst)
+    {
+        std::vector<Pointer> source;
+        for (size_t i = 0; i != elements; ++i)
+            source.push_back(create(i));
+
+        double growthSeconds = fastestSeconds([&]() {
+            std::vector<Pointer> grown;
+            for (size_t i = 0; i != elements; ++i)
+                grown.push_back(std::move(source[i]));
+            for (size_t i = 0; i != elements; ++i)
+                source[i] = std::move(grown[i]);
+        });
+
+        std::cout << separator(isFirst) << "    {\"pointer\": \"" << name << "\", \"elements\": " << elements
+            << ", \"ns_per_element\": " << nanosecondsPerOperation(elements, growthSeconds) << "}";
+    }
+
+    // Every thread copies and drops its own owner of one shared object `operations` times.
+    template <class Pointer>
+    static void runThreads(const std::string& name, size_t threadCount, size_t operations, Pointer root, bool& isFirst)
+    {
+        double seconds = fastestSeconds([&]() {
+            std::vector<std::thread> threads;
+            for (size_t i = 0; i != threadCount; ++i)
+            {
+                threads.push_back(std::thread([&root, operations]() {
+                    Pointer mine(root);
+                    for (size_t j = 0; j != operations; ++j)
+                    {
+                        Pointer copy(mine);
+                    }
+                }));
+            }
+            for (size_t i = 0; i != threadCount; ++i)
+                threads[i].join();
+        });
+
+        std::cout << separator(isFirst) << "    {\"pointer\": \"" << name << "\", \"threads\": " << threadCount
+            << ", \"operations\": " << threadCount * operations
+            << ", \"ns_per_operation\": " << nanosecondsPerOperation(threadCount * operations, seconds) << "}";
+    }
+
+int main(int argc, char* argv[])
+{
+    std::ios_base::sync_with_stdio(0);
+    bool isQuick = (argc == 2 && std::string(argv[1]) == "--quick");
+    if (argc > 2 || (argc == 2 && !isQuick))
+    {
+        std::cerr << "Usage: bench [--quick]" << std::endl;
+        return -1;
+    }
+    size_t objects = isQuick ? QUICK_OBJECTS : OBJECTS;
+    size_t threadOperations = isQuick ? QUICK_THREAD_OPERATIONS : THREAD_OPERATIONS;
+
+    auto newRing = [](size_t i) { return RingPtr(new RingObject(i)); };
+    auto newSharedRing = [](size_t i) { return SharedRingPtr(new RingObject(i)); };
+    auto newShared = [](size_t i) { return std::shared_ptr<RingObject>(new RingObject(i)); };
+    auto newUnique = [](size_t i) { return std::unique_ptr<RingObject>(new RingObject(i)); };
+
+    std::cout << "{\n  \"benchmark\": \"linked_ptr\",\n  \"ownerships\": [\n";
+    bool isFirst = true;
+    runOwnership<RingPtr>("linked_ptr ring", objects, newRing, isFirst);
+    runOwnership<smart_ptr::linked_ptr<IntrusiveObject> >("linked_ptr intrusive", objects,
+        [](size_t i) { return smart_ptr::make_linked<IntrusiveObject>(i); }, isFirst);
+    runOwnership<smart_ptr::linked_ptr<CountedObject> >("linked_ptr counted", objects,
+        [](size_t i) { return smart_ptr::linked_ptr<CountedObject>(new CountedObject(i)); }, isFirst);
+    runOwnership<smart_ptr::linked_ptr<CountedObject> >("make_linked counted", objects,
+        [](size_t i) { return smart_ptr::make_linked<CountedObject>(i); }, isFirst);
+    runOwnership<SharedCountedPtr>("make_linked counted multi_threaded", objects,
+        [](size_t i) { return smart_ptr::make_linked<CountedObject, smart_ptr::multi_threaded>(i); }, isFirst);
+    runOwnership<std::shared_ptr<RingObject> >("shared_ptr", objects, newShared, isFirst);
+    runOwnership<std::shared_ptr<RingObject> >("make_shared", objects,
+        [](size_t i) { return std::make_shared<RingObject>(i); }, isFirst);
+
+    std::cout << "\n  ],\n  \"rings\": [\n";
+    isFirst = true;
+    for (size_t i = 0; i != sizeof(RING_SIZES) / sizeof(RING_SIZES[0]); ++i)
+    {
+        runRing<RingPtr>("linked_ptr ring", objects, RING_SIZES[i], newRing, isFirst);
+        runRing<SharedRingPtr>("linked_ptr ring multi_threaded", objects, RING_SIZES[i], newSharedRing, isFirst);
+        runRing<std::shared_ptr<RingObject> >("shared_ptr", objects, RING_SIZES[i], newShared, isFirst);
+    }
+
+    std::cout << "\n  ],\n  \"growth\": [\n";
+    isFirst = true;
+    for (size_t i = 0; i != sizeof(GROWTH_SIZES) / sizeof(GROWTH_SIZES[0]); ++i)
+    {
+        size_t elements = isQuick ? GROWTH_SIZES[i] / 10 : GROWTH_SIZES[i];
+        runGrowth<RingPtr>("linked_ptr ring", elements, newRing, isFirst);
+        runGrowth<SharedRingPtr>("linked_ptr ring multi_threaded", elements, newSharedRing, isFirst);
+        runGrowth<std::shared_ptr<RingObject> >("shared_ptr", elements, newShared, isFirst);
+        runGrowth<std::unique_ptr<RingObject> >("unique_ptr", elements, newUnique, isFirst);
+    }
+
+    std::cout << "\n  ],\n  \"threads\": [\n";
+    isFirst = true;
+    for (size_t i = 0; i != sizeof(THREAD_COUNTS) / sizeof(THREAD_COUNTS[0]); ++i)
+    {
+        runThreads<SharedRingPtr>("linked_ptr ring multi_threaded", THREAD_COUNTS[i], threadOperations,
+            newSharedRing(0), isFirst);
+        runThreads<SharedCountedPtr>("make_linked counted multi_threaded", THREAD_COUNTS[i], threadOperations,
+            smart_ptr::make_linked<CountedObject, smart_ptr::multi_threaded>(0), isFirst);
+        runThreads<std::shared_ptr<RingObject> >("shared_ptr", THREAD_COUNTS[i], threadOperations,
+            newShared(0), isFirst);
+    }
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    std::cout << "\n  ],\n  \"peak_rss_kb\": " << usage.ru_maxrss << "\n}\n";
+    return 0;
+}
@@ -1,133 +1,1057 @@
 #pragma once
 
 #include <typeinfo>
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <new>
 
 namespace smart_ptr
 {
+	// Ring policies. single_threaded is the default and adds nothing to a linked_ptr.
+	// multi_threaded makes copying, swapping and destroying owners of the same object
+	// from different threads safe (as with shared_ptr, one owner object itself must not
+	// be used by two threads at once).
+	struct single_threaded
+	{
+		// Owner count of the counted and intrusive ownerships.
+		struct counter
+		{
+			counter()
+			:value(0) {}
+			
+			void increment()
+			{
+				++value;
+			}
+			
+			// True if the count dropped to zero.
+			bool decrement()
+			{
+				return --value == 0;
+			}
+			
+			// Takes one more owner unless the object is already gone.
+			bool increment_if_nonzero()
+			{
+				if (value == 0)
+					return false;
+				++value;
+				return true;
+			}
+			
+			long get() const
+			{
+				return value;
+			}
+			
+		private:
+			long value;
+		};
+		
+	protected:
+		struct guard
+		{
+			explicit guard(single_threaded const &) {}
+		};
+		
+		struct pair_guard
+		{
+			explicit pair_guard(single_threaded const &, single_threaded const &) {}
+		};
+		
+		void new_ring() const {}
+		void join_ring(single_threaded const &) const {}
+		void swap_ring(single_threaded const &) const {}
+	};
+	
+	
+	// Every ring is guarded by one of RING_LOCKS spinlocks, picked by the address of the node
+	// that started the ring, so there is no lock to allocate and rings rarely share one.
+	struct multi_threaded
+	{
+		struct counter
+		{
+			counter()
+			:value(0) {}
+			
+			void increment()
+			{
+				value.fetch_add(1, std::memory_order_relaxed);
+			}
+			
+			bool decrement()
+			{
+				return value.fetch_sub(1, std::memory_order_acq_rel) == 1;
+			}
+			
+			bool increment_if_nonzero()
+			{
+				long current = value.load(std::memory_order_relaxed);
+				do
+				{
+					if (current == 0)
+						return false;
+				} while (!value.compare_exchange_weak(current, current + 1, std::memory_order_acq_rel, std::memory_order_relaxed));
+				return true;
+			}
+			
+			long get() const
+			{
+				return value.load(std::memory_order_relaxed);
+			}
+			
+		private:
+			std::atomic<long> value;
+		};
+		
+	protected:
+		struct alignas(64) spinlock
+		{
+			static const int SPINS_BEFORE_YIELD = 64;
+			
+			std::atomic<bool> locked;
+			
+			void lock()
+			{
+				while (locked.exchange(true, std::memory_order_acquire))
+				{
+					// the holder may have been descheduled, spinning on would only burn its time slice
+					for (int spins = 0; locked.load(std::memory_order_relaxed); ++spins)
+					{
+						if (spins >= SPINS_BEFORE_YIELD)
+							std::this_thread::yield();
+					}
+				}
+			}
+			
+			void unlock()
+			{
+				locked.store(false, std::memory_order_release);
+			}
+		};
+		
+		struct guard
+		{
+			explicit guard(multi_threaded const & node)
+			:lock_(node.ring_lock)
+			{
+				lock_->lock();
+			}
+			
+			~guard()
+			{
+				lock_->unlock();
+			}
+			
+		private:
+			spinlock* lock_;
+			
+			guard(guard const &);
+			guard& operator=(guard const &);
+		};
+		
+		// Locks the rings of two nodes in address order, so two swaps can not deadlock.
+		struct pair_guard
+		{
+			explicit pair_guard(multi_threaded const & first, multi_threaded const & second)
+			:first_(first.ring_lock < second.ring_lock ? first.ring_lock : second.ring_lock)
+			,second_(first.ring_lock < second.ring_lock ? second.ring_lock : first.ring_lock)
+			{
+				first_->lock();
+				if (second_ != first_)
+					second_->lock();
+			}
+			
+			~pair_guard()
+			{
+				if (second_ != first_)
+					second_->unlock();
+				first_->unlock();
+			}
+			
+		private:
+			spinlock* first_;
+			spinlock* second_;
+			
+			pair_guard(pair_guard const &);
+			pair_guard& operator=(pair_guard const &);
+		};
+		
+		void new_ring() const
+		{
+			std::uintptr_t address = reinterpret_cast<std::uintptr_t>(this);
+			ring_lock = &ring_locks()[((address >> 4) ^ (address >> 12)) % RING_LOCKS];
+		}
+		
+		void join_ring(multi_threaded const & from) const
+		{
+			ring_lock = from.ring_lock;
+		}
+		
+		void swap_ring(multi_threaded const & another) const
+		{
+			spinlock* temp = ring_lock;
+			ring_lock = another.ring_lock;
+			another.ring_lock = temp;
+		}
+		
+	private:
+		static const std::size_t RING_LOCKS = 64;
+		
+		mutable spinlock* ring_lock;
+		
+		static spinlock* ring_locks()
+		{
+			static spinlock locks[RING_LOCKS];
+			return locks;
+		}
+	};
+	
+	
+	// Ownership strategies, picked per type through linked_traits:
+	//   ring_ownership       owners of one object are linked into a ring (the default);
+	//   intrusive_ownership  the object carries its own count, see linked_counter;
+	//   counted_ownership    owners share a control block, which make_linked allocates
+	//                        together with the object.
+	struct ring_ownership {};
+	struct intrusive_ownership {};
+	struct counted_ownership {};
+	
+	
+	// Base for types that count their own owners. Specializing linked_traits with
+	// intrusive_ownership for a derived type makes a linked_ptr to it a single pointer.
+	// Types with a counter of their own can do the same by providing linked_add_ref,
+	// linked_release and linked_use_count found by argument-dependent lookup.
+	template <class Policy = single_threaded>
+	class linked_counter
+	{
+	protected:
+		linked_counter() {}
+		linked_counter(linked_counter const &) {}
+		linked_counter& operator=(linked_counter const &)
+		{
+			return *this;
+		}
+		~linked_counter() {}
+		
+	private:
+		mutable typename Policy::counter owners_;
+		
+		friend void linked_add_ref(linked_counter const * p)
+		{
+			p->owners_.increment();
+		}
+		
+		friend bool linked_release(linked_counter const * p)
+		{
+			return p->owners_.decrement();
+		}
+		
+		friend long linked_use_count(linked_counter const * p)
+		{
+			return p->owners_.get();
+		}
+	};
+	
+	
+	// Looks only at the name of T, so a linked_ptr to an incomplete type can be declared.
+	template <class T>
+	struct linked_traits
+	{
+		typedef ring_ownership ownership;
+	};
+	
+	
 	namespace details
 	{
 		template <class T>
 		void simple_swap(T& first, T& second)
 		{
-			T temp = first;
-			first = second;
-			second = temp;
-		}
+			T temp = first;
+			first = second;
+			second = temp;
+		}
+		
+		
+		// Weak references to a ring go through an anchor: a node kept at the head of the ring,
+		// recognized by its prev pointing to itself. It counts the weak references and is
+		// freed with the last of them; when the last owner leaves, the anchor is left alone
+		// in its ring, which is how weak references see that the object is gone.
+		template <class Policy>
+		struct linked : private Policy
+		{
+			struct anchor;
+			
+			explicit linked()
+			:next(nullptr)
+			,prev(nullptr)
+			{
+				this->new_ring();
+			}
+			
+			bool linked_unique() const
+			{
+				typename Policy::guard lock(*this);
+				return alone();
+			}
+			
+			void insert_after(linked const & from)
+			{
+				typename Policy::guard lock(from);
+				insert_after_locked(from);
+			}
+			
+			// Returns the anchor of the ring of `node` with one more weak reference, creating it if needed.
+			// Finding an existing anchor walks to the head of the ring.
+			static anchor* observe(linked const & node)
+			{
+				anchor* spare = new anchor();
+				anchor* result;
+				{
+					typename Policy::guard lock(node);
+					linked* head = (linked*)&node;
+					while (head->prev != nullptr && !head->is_anchor())
+						head = head->prev;
+					
+					if (!head->is_anchor())
+					{
+						spare->join_ring(node);
+						spare->prev = spare;
+						spare->next = head;
+						head->prev = spare;
+						head = spare;
+						spare = nullptr;
+					}
+					result = static_cast<anchor*>(head);
+					++result->weak_owners;
+				}
+				delete spare;
+				return result;
+			}
+			
+			static void observe_again(anchor* from)
+			{
+				typename Policy::guard lock(*from);
+				++from->weak_owners;
+			}
+			
+			// Drops a weak reference; the last one takes the anchor out of the ring and frees it.
+			static void forget(anchor* from)
+			{
+				{
+					typename Policy::guard lock(*from);
+					if (--from->weak_owners != 0)
+						return;
+					if (from->next != nullptr)
+						from->next->prev = nullptr;
+				}
+				delete from;
+			}
+			
+			static bool expired(anchor* from)
+			{
+				typename Policy::guard lock(*from);
+				return from->next == nullptr;
+			}
+			
+			static long owner_count(anchor* from)
+			{
+				typename Policy::guard lock(*from);
+				long size = 0;
+				for (linked* node = from->next; node != nullptr; node = node->next)
+					++size;
+				return size;
+			}
+			
+			// Makes this fresh node an owner next to the anchor, unless the object is already gone.
+			bool join_anchor(anchor* from)
+			{
+				typename Policy::guard lock(*from);
+				if (from->next == nullptr)
+					return false;
+				insert_after_locked(*from);
+				return true;
+			}
+			
+			// Takes the place of `from` in its ring, touching each neighbour once; `from` is left alone.
+			// This node must be alone.
+			void replace(linked & from)
+			{
+				typename Policy::guard lock(from);
+				this->join_ring(from);
+				next = from.next;
+				prev = from.prev;
+				update_links();
+				from.next = nullptr;
+				from.prev = nullptr;
+			}
+			
+			void swap_linked(const linked & another)
+			{
+				typename Policy::pair_guard lock(*this, another);
+				simple_swap(next, another.next);
+				simple_swap(prev, another.prev);
+				this->swap_ring(another);
+				update_links();
+				another.update_links();
+			}
+			
+			// Walks the whole ring, so it is linear in the number of owners.
+			long ring_size() const
+			{
+				typename Policy::guard lock(*this);
+				long size = 1;
+				for (linked* node = next; node != nullptr; node = node->next)
+					++size;
+				for (linked* node = prev; node != nullptr && !node->is_anchor(); node = node->prev)
+					++size;
+				return size;
+			}
+			
+			// Leaves the ring; true if this node was the last one in it.
+			bool unlink()
+			{
+				typename Policy::guard lock(*this);
+				if (alone())
+				{
+					// leave the anchor, if any, alone in the ring: its weak references are expired now
+					if (prev != nullptr)
+						prev->next = nullptr;
+					prev = nullptr;
+					return true;
+				}
+				
+				if (next != nullptr)
+					next->prev = prev;
+				
+				if (prev != nullptr)
+					prev->next = next;
+				
+				next = nullptr;
+				prev = nullptr;
+				return false;
+			}
+			
+		private:
+			mutable linked* next;
+			mutable linked* prev;
+			
+			void setNext(linked* next) const
+			{
+				this->next = next;
+			}
+			void setPrev(linked* prev) const
+			{
+				this->prev = prev;
+			}
+			
+			bool is_anchor() const
+			{
+				return prev == this;
+			}
+			
+			// No other owner in the ring; an anchor does not count.
+			bool alone() const
+			{
+				return next == nullptr && (prev == nullptr || prev->is_anchor());
+			}
+			
+			void insert_after_locked(linked const & from)
+			{
+				this->join_ring(from);
+				next = from.next;
+				if (next != nullptr)
+					next->prev = this;
+				
+				prev = (linked*)&from;
+				from.setNext(this);
+			}
+			
+			void update_links() const
+			{
+				if (next != nullptr)
+				{
+					next->prev = (linked*)this;
+				}
+			
+				if (prev != nullptr)
+				{
+					prev->next = (linked*)this;
+				}
+			}
+		};
+		
+		template <class Policy>
+		struct linked<Policy>::anchor : linked<Policy>
+		{
+			anchor()
+			:weak_owners(0) {}
+			
+			// guarded by the ring lock
+			long weak_owners;
+		};
+		
+		
+		// Keeps a deleter; an empty one takes no space, being a base class.
+		template <class Deleter, bool = std::is_empty<Deleter>::value>
+		struct deleter_holder : private Deleter
+		{
+			deleter_holder() {}
+			
+			explicit deleter_holder(Deleter const & deleter)
+			:Deleter(deleter) {}
+			
+			Deleter& deleter()
+			{
+				return *this;
+			}
+			
+			Deleter const & deleter() const
+			{
+				return *this;
+			}
+		};
+		
+		template <class Deleter>
+		struct deleter_holder<Deleter, false>
+		{
+			deleter_holder()
+			:stored() {}
+			
+			explicit deleter_holder(Deleter const & deleter)
+			:stored(deleter) {}
+			
+			Deleter& deleter()
+			{
+				return stored;
+			}
+			
+			Deleter const & deleter() const
+			{
+				return stored;
+			}
+			
+		private:
+			Deleter stored;
+		};
+		
+		
+		// Ring and intrusive owners free the object with the deleter of the last owner;
+		// the counted owner keeps the deleter it was created with in the control block.
+		template <class Ownership, class Policy>
+		struct owner;
+		
+		template <class Policy>
+		struct owner<ring_ownership, Policy> : linked<Policy>
+		{
+			template <class T, class... Args>
+			T* emplace(Args&&... args)
+			{
+				return new T(std::forward<Args>(args)...);
+			}
+			
+			template <class T, class Deleter>
+			void adopt(T*, Deleter const &) {}
+			
+			template <class T>
+			void share(owner const & from, T*)
+			{
+				this->insert_after(from);
+			}
+			
+			void swap_owner(owner const & another)
+			{
+				this->swap_linked(another);
+			}
+			
+			void move_owner(owner & from)
+			{
+				this->replace(from);
+			}
+			
+			// Leaves the ring of `old` and takes the place of `from`; `old` is freed last,
+			// as it may own `from`.
+			template <class T, class Deleter>
+			void replace_owner(owner & from, T* old, Deleter & deleter)
+			{
+				bool last = this->unlink();
+				this->replace(from);
+				if (last && old != nullptr)
+				{
+					deleter(old);
+				}
+			}
+			
+			template <class T, class Deleter>
+			void release(T* p, Deleter & deleter)
+			{
+				if (this->unlink() && p != nullptr)
+				{
+					deleter(p);
+				}
+			}
+			
+			template <class T>
+			bool unique_owner(T*) const
+			{
+				return this->linked_unique();
+			}
+			
+			template <class T>
+			long owner_count(T* p) const
+			{
+				return p == nullptr ? 0 : this->ring_size();
+			}
+		};
+		
+		template <class Policy>
+		struct owner<intrusive_ownership, Policy>
+		{
+			template <class T, class... Args>
+			T* emplace(Args&&... args)
+			{
+				T* p = new T(std::forward<Args>(args)...);
+				linked_add_ref(p);
+				return p;
+			}
+			
+			template <class T, class Deleter>
+			void adopt(T* p, Deleter const &)
+			{
+				if (p != nullptr)
+					linked_add_ref(p);
+			}
+			
+			template <class T>
+			void share(owner const &, T* p)
+			{
+				if (p != nullptr)
+					linked_add_ref(p);
+			}
+			
+			void swap_owner(owner const &) {}
+			
+			void move_owner(owner &) {}
+			
+			template <class T, class Deleter>
+			void replace_owner(owner &, T* old, Deleter & deleter)
+			{
+				release(old, deleter);
+			}
+			
+			template <class T, class Deleter>
+			void release(T* p, Deleter & deleter)
+			{
+				if (p != nullptr && linked_release(p))
+				{
+					deleter(p);
+				}
+			}
+			
+			template <class T>
+			bool unique_owner(T* p) const
+			{
+				return linked_use_count(p) == 1;
+			}
+			
+			template <class T>
+			long owner_count(T* p) const
+			{
+				return p == nullptr ? 0 : linked_use_count(p);
+			}
+		};
+		
+		// Control block of counted_ownership. The owners together hold one weak reference,
+		// so the block outlives the object while any linked_weak_ptr still observes it.
+		template <class Policy>
+		struct control_block
+		{
+			typename Policy::counter owners;
+			typename Policy::counter weak_owners;
+			
+			control_block()
+			{
+				weak_owners.increment();
+			}
+			
+			void release_owner()
+			{
+				if (owners.decrement())
+				{
+					destroy();
+					release_weak();
+				}
+			}
+			
+			void release_weak()
+			{
+				if (weak_owners.decrement())
+					deallocate();
+			}
+			
+		protected:
+			~control_block() {}
+			
+		private:
+			virtual void destroy() = 0;
+			virtual void deallocate() = 0;
+		};
+		
+		template <class T, class Policy, class Deleter>
+		struct pointer_block final : control_block<Policy>, private deleter_holder<Deleter>
+		{
+			explicit pointer_block(T* p, Deleter const & deleter)
+			:deleter_holder<Deleter>(deleter)
+			,p(p) {}
+			
+		private:
+			T* p;
+			
+			virtual void destroy()
+			{
+				this->deleter()(p);
+			}
+			
+			virtual void deallocate()
+			{
+				delete this;
+			}
+		};
+		
+		template <class T, class Policy>
+		struct inplace_block final : control_block<Policy>
+		{
+			template <class... Args>
+			explicit inplace_block(Args&&... args)
+			{
+				new (&storage) T(std::forward<Args>(args)...);
+			}
+			
+			T* object()
+			{
+				return reinterpret_cast<T*>(&storage);
+			}
+			
+		private:
+			typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+			
+			virtual void destroy()
+			{
+				object()->~T();
+			}
+			
+			virtual void deallocate()
+			{
+				delete this;
+			}
+		};
+		
+		template <class Policy>
+		struct owner<counted_ownership, Policy>
+		{
+			owner()
+			:block(nullptr) {}
+			
+			template <class T, class... Args>
+			T* emplace(Args&&... args)
+			{
+				inplace_block<T, Policy>* created = new inplace_block<T, Policy>(std::forward<Args>(args)...);
+				block = created;
+				block->owners.increment();
+				return created->object();
+			}
+			
+			template <class T, class Deleter>
+			void adopt(T* p, Deleter const & deleter)
+			{
+				if (p != nullptr)
+				{
+					try
+					{
+						block = new pointer_block<T, Policy, Deleter>(p, deleter);
+					}
+					catch (...)
+					{
+						Deleter release(deleter);
+						release(p);
+						throw;
+					}
+					block->owners.increment();
+				}
+			}
+			
+			template <class T>
+			void share(owner const & from, T*)
+			{
+				block = from.block;
+				if (block != nullptr)
+					block->owners.increment();
+			}
+			
+			void swap_owner(owner & another)
+			{
+				simple_swap(block, another.block);
+			}
+			
+			void move_owner(owner & from)
+			{
+				block = from.block;
+				from.block = nullptr;
+			}
+			
+			template <class T, class Deleter>
+			void replace_owner(owner & from, T*, Deleter &)
+			{
+				control_block<Policy>* previous = block;
+				move_owner(from);
+				if (previous != nullptr)
+					previous->release_owner();
+			}
+			
+			template <class T, class Deleter>
+			void release(T*, Deleter &)
+			{
+				if (block != nullptr)
+					block->release_owner();
+			}
+			
+			template <class T>
+			bool unique_owner(T*) const
+			{
+				return block != nullptr && block->owners.get() == 1;
+			}
+			
+			template <class T>
+			long owner_count(T*) const
+			{
+				return block == nullptr ? 0 : block->owners.get();
+			}
+			
+			control_block<Policy>* shared_block() const
+			{
+				return block;
+			}
+			
+			// Becomes an owner of the object of `from`, unless it is already gone.
+			bool join_block(control_block<Policy>* from)
+			{
+				if (!from->owners.increment_if_nonzero())
+					return false;
+				block = from;
+				return true;
+			}
+			
+		private:
+			control_block<Policy>* block;
+		};
 		
 		
-		struct linked
+		// What a linked_weak_ptr keeps to observe the owners of an object.
+		template <class Ownership, class Policy>
+		struct weak_owner
 		{
-			explicit linked()
-			:next(nullptr)
-			,prev(nullptr) {}
+			static_assert(!std::is_same<Ownership, Ownership>::value,
+				"linked_weak_ptr needs ring_ownership or counted_ownership: an intrusive count dies with its object");
+		};
+		
+		template <class Policy>
+		struct weak_owner<ring_ownership, Policy>
+		{
+			typedef typename linked<Policy>::anchor anchor;
 			
-			explicit linked(linked* next, linked* prev)
-			:next(next)
-			,prev(prev) {}
+			weak_owner()
+			:ring_anchor(nullptr) {}
 			
-			bool linked_unique() const
+			void observe(owner<ring_ownership, Policy> const & from)
 			{
-				if ((next == nullptr) && (prev == nullptr))
-					return true;
-				else
-					return false;
+				ring_anchor = linked<Policy>::observe(from);
 			}
 			
-			void insert_after(linked const & from)
+			void observe_weak(weak_owner const & from)
 			{
-				next = from.next;
-				if (next != nullptr)
-					next->prev = this;
-				
-				prev = (linked*)&from;
-				from.setNext(this);
+				ring_anchor = from.ring_anchor;
+				if (ring_anchor != nullptr)
+					linked<Policy>::observe_again(ring_anchor);
 			}
 			
-			void swap_linked(const linked & another)
-			{			
-				simple_swap(next, another.next);
-				simple_swap(prev, another.prev);
-				update_links();
-				another.update_links();
+			void swap_weak(weak_owner & another)
+			{
+				simple_swap(ring_anchor, another.ring_anchor);
 			}
 			
-			~linked()
+			void forget()
 			{
-				if (next != nullptr)
-					next->prev = prev;
-				
-				if (prev != nullptr)
-					prev->next = next;
+				if (ring_anchor != nullptr)
+					linked<Policy>::forget(ring_anchor);
+			}
+			
+			bool weak_expired() const
+			{
+				return ring_anchor == nullptr || linked<Policy>::expired(ring_anchor);
+			}
+			
+			long weak_owner_count() const
+			{
+				return ring_anchor == nullptr ? 0 : linked<Policy>::owner_count(ring_anchor);
+			}
+			
+			bool lock_into(owner<ring_ownership, Policy> & result) const
+			{
+				return ring_anchor != nullptr && result.join_anchor(ring_anchor);
 			}
 			
 		private:
-			mutable linked* next;
-			mutable linked* prev;
+			anchor* ring_anchor;
+		};
+		
+		template <class Policy>
+		struct weak_owner<counted_ownership, Policy>
+		{
+			weak_owner()
+			:block(nullptr) {}
 			
-			void setNext(linked* next) const
+			void observe(owner<counted_ownership, Policy> const & from)
 			{
-				this->next = next;
+				block = from.shared_block();
+				if (block != nullptr)
+					block->weak_owners.increment();
 			}
-			void setPrev(linked* prev) const
+			
+			void observe_weak(weak_owner const & from)
 			{
-				this->prev = prev;
+				block = from.block;
+				if (block != nullptr)
+					block->weak_owners.increment();
 			}
 			
-			void update_links() const
+			void swap_weak(weak_owner & another)
 			{
-				if (next != nullptr)
-				{
-					next->prev = (linked*)this;
-				}
+				simple_swap(block, another.block);
+			}
 			
-				if (prev != nullptr)
-				{
-					prev->next = (linked*)this;
-				}
+			void forget()
+			{
+				if (block != nullptr)
+					block->release_weak();
+			}
+			
+			bool weak_expired() const
+			{
+				return block == nullptr || block->owners.get() == 0;
+			}
+			
+			long weak_owner_count() const
+			{
+				return block == nullptr ? 0 : block->owners.get();
+			}
+			
+			bool lock_into(owner<counted_ownership, Policy> & result) const
+			{
+				return block != nullptr && result.join_block(block);
 			}
+			
+		private:
+			control_block<Policy>* block;
 		};
+		
+		struct make_tag {};
 	} //details
 	
 	
-	template<class T>
-	struct linked_ptr : private details::linked
+	// Deleter is called on the object by its last owner (by the control block for counted_ownership).
+	// linked_ptr<T[]> owns an array, deleted with delete[] by default.
+	template<class T, class Policy = single_threaded, class Deleter = std::default_delete<T> >
+	struct linked_ptr;
+	
+	template<class T, class Policy = single_threaded, class Deleter = std::default_delete<T> >
+	struct linked_weak_ptr;
+	
+	// Creates the object and its owner in one go; with counted_ownership both share one allocation.
+	template <class T, class Policy = single_threaded, class... Args>
+	linked_ptr<T, Policy> make_linked(Args&&... args);
+	
+	
+	template<class T, class Policy, class Deleter>
+	struct linked_ptr : private details::owner<typename linked_traits<T>::ownership, Policy>,
+		private details::deleter_holder<Deleter>
 	{
-		T& operator*() const
+		typedef typename std::remove_extent<T>::type element_type;
+		typedef Deleter deleter_type;
+		
+		element_type& operator*() const
 		{
 			return *p_;
 		}
-		T* operator->() const
+		element_type* operator->() const
 		{
 			return p_;
 		}
-		T* get() const
+		element_type& operator[](std::size_t index) const
+		{
+			static_assert(std::is_array<T>::value, "operator[] is only defined for linked_ptr<T[]>");
+			return p_[index];
+		}
+		element_type* get() const
 		{
 			return p_;
 		}
 		
+		Deleter& get_deleter()
+		{
+			return this->deleter();
+		}
+		
+		Deleter const & get_deleter() const
+		{
+			return this->deleter();
+		}
+		
 		bool unique() const
 		{
-			if (p_ != nullptr && linked_unique())
+			if (p_ != nullptr && this->unique_owner(p_))
 				return true;
 			else
 				return false;
 		}
 		
+		// Constant time for the counted and intrusive ownerships, linear in the ring size otherwise.
+		long use_count() const
+		{
+			return this->owner_count(p_);
+		}
+		
 		linked_ptr()
-			:linked()
+			:owner_type()
+			,deleter_holder_type()
 			,p_(nullptr)
 		{}
 		
-		explicit linked_ptr(T* p)
-			:linked()
+		explicit linked_ptr(element_type* p)
+			:owner_type()
+			,deleter_holder_type()
 			,p_(p)
-		{}
+		{
+			this->adopt(p, this->deleter());
+		}
+		
+		linked_ptr(element_type* p, Deleter const & deleter)
+			:owner_type()
+			,deleter_holder_type(deleter)
+			,p_(p)
+		{
+			this->adopt(p, this->deleter());
+		}
 		
 		linked_ptr(const linked_ptr & from)
-			:linked()
+			:owner_type()
+			,deleter_holder_type(from.get_deleter())
 			,p_(from.get())
 		{
-			insert_after(from);
+			this->share(from, p_);
 		}
 		
 		linked_ptr& operator=(const linked_ptr & from)
@@ -139,28 +1063,76 @@ namespace smart_ptr
 			return *this;
 		}
 
-		template <class U>
-		linked_ptr(linked_ptr<U> const & from)
-			:linked()
+		// Moves take the place of `from` among the owners; no count or ring size changes.
+		linked_ptr(linked_ptr && from) noexcept
+			:owner_type()
+			,deleter_holder_type(from.get_deleter())
+			,p_(from.p_)
+		{
+			this->move_owner(from);
+			from.p_ = nullptr;
+		}
+		
+		linked_ptr& operator=(linked_ptr && from) noexcept
+		{
+			if (&from != this)
+				move_assign(from);
+			return *this;
+		}
+		
+		template <class U, class UDeleter>
+		linked_ptr(linked_ptr<U, Policy, UDeleter> && from)
+			:owner_type()
+			,deleter_holder_type(from.get_deleter())
+			,p_(from.get())
+		{
+			static_assert(std::is_same<typename linked_traits<U>::ownership, typename linked_traits<T>::ownership>::value,
+				"linked_ptr can only be converted between types with the same ownership");
+			static_assert(!std::is_array<T>::value && !std::is_array<U>::value,
+				"linked_ptr<T[]> can not be converted");
+			this->move_owner(from);
+			from.p_ = nullptr;
+		}
+		
+		template <class U, class UDeleter>
+		linked_ptr& operator=(linked_ptr<U, Policy, UDeleter> && from)
+		{
+			static_assert(std::is_same<typename linked_traits<U>::ownership, typename linked_traits<T>::ownership>::value,
+				"linked_ptr can only be converted between types with the same ownership");
+			static_assert(!std::is_array<T>::value && !std::is_array<U>::value,
+				"linked_ptr<T[]> can not be converted");
+			move_assign(from);
+			return *this;
+		}
+		
+		template <class U, class UDeleter>
+		linked_ptr(linked_ptr<U, Policy, UDeleter> const & from)
+			:owner_type()
+			,deleter_holder_type(from.get_deleter())
 			,p_(from.get())
 		{
-			insert_after(from);
+			static_assert(std::is_same<typename linked_traits<U>::ownership, typename linked_traits<T>::ownership>::value,
+				"linked_ptr can only be converted between types with the same ownership");
+			static_assert(!std::is_array<T>::value && !std::is_array<U>::value,
+				"linked_ptr<T[]> can not be converted");
+			this->share(from, p_);
 		}
 		
 		
 		
 		template <class U>
-		void swap(linked_ptr<U>& another)
+		void swap(linked_ptr<U, Policy, Deleter>& another)
 		{
 			if (*this == another)
 				return;
-			swap_linked(another);			
+			this->swap_owner(another);
+			details::simple_swap(this->deleter(), another.deleter());
 			details::simple_swap(p_, another.p_);
 		}
 		
 		
-		template <class U>
-		linked_ptr& operator=(const linked_ptr<U>& from)
+		template <class U, class UDeleter>
+		linked_ptr& operator=(const linked_ptr<U, Policy, UDeleter>& from)
 		{
 			if (*this == from)
 				return *this;
@@ -171,23 +1143,26 @@ namespace smart_ptr
 		
 		void reset()
 		{
-			linked_ptr temp;
+			linked_ptr temp(nullptr, this->deleter());
+			this->swap(temp);
+		}
+		
+		void reset(element_type* p)
+		{
+			linked_ptr temp(p, this->deleter());
 			this->swap(temp);
 		}
 		
-		void reset(T* p)
+		void reset(element_type* p, Deleter const & deleter)
 		{
-			linked_ptr temp(p);
+			linked_ptr temp(p, deleter);
 			this->swap(temp);
 		}
 		
 		~linked_ptr()
 		{
-			if (linked_unique())
-			{
-				delete p_;
-			}
-			(void)sizeof(T);
+			(void)sizeof(element_type);
+			this->release(p_, this->deleter());
 		}
 		
 		explicit operator bool() const
@@ -197,45 +1172,238 @@ namespace smart_ptr
 		
 
 	private:
-		mutable T * p_;
+		typedef details::owner<typename linked_traits<T>::ownership, Policy> owner_type;
+		typedef details::deleter_holder<Deleter> deleter_holder_type;
+		
+		mutable element_type * p_;
+		
+		template <class U, class UDeleter>
+		void move_assign(linked_ptr<U, Policy, UDeleter> & from)
+		{
+			element_type* old = p_;
+			Deleter oldDeleter(this->deleter());
+			this->deleter() = from.get_deleter();
+			p_ = from.p_;
+			from.p_ = nullptr;
+			this->replace_owner(from, old, oldDeleter);
+		}
+		
+		template <class... Args>
+		explicit linked_ptr(details::make_tag, Args&&... args)
+			:owner_type()
+			,deleter_holder_type()
+			,p_(nullptr)
+		{
+			p_ = this->template emplace<T>(std::forward<Args>(args)...);
+		}
 		
-		template< class >
+		template< class, class, class >
    		friend struct linked_ptr;
+		
+		template< class, class, class >
+		friend struct linked_weak_ptr;
+		
+		template <class U, class UPolicy, class... Args>
+		friend linked_ptr<U, UPolicy> make_linked(Args&&... args);
+	};
+	
+	
+	template <class T, class Policy, class... Args>
+	linked_ptr<T, Policy> make_linked(Args&&... args)
+	{
+		static_assert(!std::is_array<T>::value, "make_linked does not create arrays");
+		return linked_ptr<T, Policy>(details::make_tag(), std::forward<Args>(args)...);
+	}
+	
+	
+	// Deleter that hands an object back to the allocator it came from.
+	template <class Allocator>
+	struct allocator_delete : private Allocator
+	{
+		typedef std::allocator_traits<Allocator> traits;
+		
+		allocator_delete() {}
+		
+		explicit allocator_delete(Allocator const & allocator)
+		:Allocator(allocator) {}
+		
+		void operator()(typename traits::value_type* p)
+		{
+			Allocator& allocator = *this;
+			traits::destroy(allocator, p);
+			traits::deallocate(allocator, p, 1);
+		}
+	};
+	
+	// Creates the object with `allocator`, typically a pool, and returns it there when the last owner dies.
+	// The control block of counted_ownership still comes from the global heap.
+	template <class T, class Policy = single_threaded, class Allocator, class... Args>
+	linked_ptr<T, Policy, allocator_delete<typename std::allocator_traits<Allocator>::template rebind_alloc<T> > >
+		allocate_linked(Allocator const & allocator, Args&&... args)
+	{
+		typedef typename std::allocator_traits<Allocator>::template rebind_alloc<T> object_allocator;
+		typedef std::allocator_traits<object_allocator> traits;
+		
+		object_allocator rebound(allocator);
+		T* p = traits::allocate(rebound, 1);
+		try
+		{
+			traits::construct(rebound, p, std::forward<Args>(args)...);
+		}
+		catch (...)
+		{
+			traits::deallocate(rebound, p, 1);
+			throw;
+		}
+		return linked_ptr<T, Policy, allocator_delete<object_allocator> >(p, allocator_delete<object_allocator>(rebound));
+	}
+	
+	
+	// Observes the owners of an object without keeping it alive. expired() is constant time;
+	// lock() gives an owner, or an empty linked_ptr once the object is gone.
+	template<class T, class Policy, class Deleter>
+	struct linked_weak_ptr : private details::weak_owner<typename linked_traits<T>::ownership, Policy>,
+		private details::deleter_holder<Deleter>
+	{
+		linked_weak_ptr()
+			:weak_owner_type()
+			,deleter_holder_type()
+			,p_(nullptr)
+		{}
+		
+		template <class U, class UDeleter>
+		linked_weak_ptr(linked_ptr<U, Policy, UDeleter> const & from)
+			:weak_owner_type()
+			,deleter_holder_type(from.get_deleter())
+			,p_(from.get())
+		{
+			static_assert(std::is_same<typename linked_traits<U>::ownership, typename linked_traits<T>::ownership>::value,
+				"linked_weak_ptr can only observe types with the same ownership");
+			if (p_ != nullptr)
+				this->observe(from);
+		}
+		
+		linked_weak_ptr(const linked_weak_ptr & from)
+			:weak_owner_type()
+			,deleter_holder_type(from.deleter())
+			,p_(from.p_)
+		{
+			this->observe_weak(from);
+		}
+		
+		template <class U, class UDeleter>
+		linked_weak_ptr(linked_weak_ptr<U, Policy, UDeleter> const & from)
+			:weak_owner_type()
+			,deleter_holder_type(from.deleter())
+			,p_(from.p_)
+		{
+			static_assert(std::is_same<typename linked_traits<U>::ownership, typename linked_traits<T>::ownership>::value,
+				"linked_weak_ptr can only be converted between types with the same ownership");
+			this->observe_weak(from);
+		}
+		
+		linked_weak_ptr& operator=(const linked_weak_ptr & from)
+		{
+			linked_weak_ptr temp(from);
+			this->swap(temp);
+			return *this;
+		}
+		
+		template <class U, class UDeleter>
+		linked_weak_ptr& operator=(const linked_weak_ptr<U, Policy, UDeleter> & from)
+		{
+			linked_weak_ptr temp(from);
+			this->swap(temp);
+			return *this;
+		}
+		
+		template <class U, class UDeleter>
+		linked_weak_ptr& operator=(const linked_ptr<U, Policy, UDeleter> & from)
+		{
+			linked_weak_ptr temp(from);
+			this->swap(temp);
+			return *this;
+		}
+		
+		void swap(linked_weak_ptr & another)
+		{
+			this->swap_weak(another);
+			details::simple_swap(this->deleter(), another.deleter());
+			details::simple_swap(p_, another.p_);
+		}
+		
+		void reset()
+		{
+			linked_weak_ptr temp;
+			this->swap(temp);
+		}
+		
+		bool expired() const
+		{
+			return this->weak_expired();
+		}
+		
+		long use_count() const
+		{
+			return this->weak_owner_count();
+		}
+		
+		linked_ptr<T, Policy, Deleter> lock() const
+		{
+			linked_ptr<T, Policy, Deleter> result(nullptr, this->deleter());
+			if (this->lock_into(result))
+				result.p_ = p_;
+			return result;
+		}
+		
+		~linked_weak_ptr()
+		{
+			this->forget();
+		}
+		
+	private:
+		typedef details::weak_owner<typename linked_traits<T>::ownership, Policy> weak_owner_type;
+		typedef details::deleter_holder<Deleter> deleter_holder_type;
+		
+		typename linked_ptr<T, Policy, Deleter>::element_type * p_;
+		
+		template< class, class, class >
+		friend struct linked_weak_ptr;
 	};
 	
 	
-	template <class T, class U>
-	bool operator==(const linked_ptr<T>& first, const linked_ptr<U>& second)
+	template <class T, class D, class U, class E, class Policy>
+	bool operator==(const linked_ptr<T, Policy, D>& first, const linked_ptr<U, Policy, E>& second)
 	{
 		return first.get() == second.get();
 	}
 	
-	template <class T, class U>
-	bool operator!=(const linked_ptr<T>& first, const linked_ptr<U>& second)
+	template <class T, class D, class U, class E, class Policy>
+	bool operator!=(const linked_ptr<T, Policy, D>& first, const linked_ptr<U, Policy, E>& second)
 	{
 		return !(first == second);
 	}
 	
-	template <class T, class U>
-	bool operator<(const linked_ptr<T>& first, const linked_ptr<U>& second)
+	template <class T, class D, class U, class E, class Policy>
+	bool operator<(const linked_ptr<T, Policy, D>& first, const linked_ptr<U, Policy, E>& second)
 	{
 		return first.get() < second.get();
 	}
 	
-	template <class T, class U>
-	bool operator<=(const linked_ptr<T>& first, const linked_ptr<U>& second)
+	template <class T, class D, class U, class E, class Policy>
+	bool operator<=(const linked_ptr<T, Policy, D>& first, const linked_ptr<U, Policy, E>& second)
 	{
 		return ((first == second) || (first < second));
 	}
 	
-	template <class T, class U>
-	bool operator>(const linked_ptr<T>& first, const linked_ptr<U>& second)
+	template <class T, class D, class U, class E, class Policy>
+	bool operator>(const linked_ptr<T, Policy, D>& first, const linked_ptr<U, Policy, E>& second)
 	{
 		return !(first <= second);
 	}
 	
-	template <class T, class U>
-	bool operator>=(const linked_ptr<T>& first, const linked_ptr<U>& second)
+	template <class T, class D, class U, class E, class Policy>
+	bool operator>=(const linked_ptr<T, Policy, D>& first, const linked_ptr<U, Policy, E>& second)
 	{
 		return !(first < second);
 	}
@@ -0,0 +1,126 @@
+#include <iostream>
+#include <algorithm>
+#include <string>
+#include <chrono>
+#include <cstdlib>
+#include <new>
+#include "lazy_string.hpp"
+
+// Cost of building a string by appending long shared pieces alternated with single
+// characters, lazy_string next to std::string, printed as JSON:
+//   bench [--quick]
+// Every run is repeated until it has run for MIN_PHASE_SECONDS and the fastest run is reported.
+// allocated_per_byte is the heap bytes one run allocates per byte of the result. It stays
+// bounded while appending is amortized linear and grows with the piece count once it is not;
+// the bench exits with 1 when it passes MAX_ALLOCATED_PER_BYTE.
+
+static double const MIN_PHASE_SECONDS = 0.2;
+
+static size_t const MIN_PHASE_RUNS = 3;
+
+static size_t const PIECE_LENGTH = 200;
+
+static size_t const PIECE_COUNTS[] = { 1000, 8000, 64000 };
+
+static size_t const QUICK_PIECE_COUNTS[] = { 1000, 8000 };
+
+static double const MAX_ALLOCATED_PER_BYTE = 8;
+
+static size_t allocatedBytes = 0;
+
+void* operator new(size_t size)
+{
+    allocatedBytes += size;
+    if (void* memory = std::malloc(size ? size : 1))
+        return memory;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept
+{
+    std::free(memory);
+}
+
+    template <class Phase>
+    static double fastestSeconds(Phase phase)
+    {
+        double best = 1e30;
+        double total = 0;
+        for (size_t runs = 0; runs < MIN_PHASE_RUNS || total < MIN_PHASE_SECONDS; ++runs)
+        {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            phase();
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            best = std::min(best, seconds);
+            total += seconds;
+        }
+        return best;
+    }
+
+    static const char* separator(bool& isFirst)
+    {
+        const char* result = isFirst ? "" : ",\n";
+        isFirst = false;
+        return result;
+    }
+
+    // Appends `pieces` copies of `piece`, each followed by '\n'. Returns false when the run
+    // allocated more than MAX_ALLOCATED_PER_BYTE per byte of the result.
+    template <class String>
+    static bool runAlternating(const std::string& name, size_t pieces, bool& isFirst)
+    {
+        String piece(std::string(PIECE_LENGTH, 'x').c_str());
+        size_t length = 0;
+        double allocatedPerByte = 0;
+
+        double seconds = fastestSeconds([&]() {
+            size_t allocatedBefore = allocatedBytes;
+            String result;
+            for (size_t i = 0; i != pieces; ++i)
+            {
+                result += piece;
+                result += '\n';
+            }
+            length = result.size();
+            allocatedPerByte = double(allocatedBytes - allocatedBefore) / length;
+        });
+
+        std::cout << separator(isFirst) << "    {\"string\": \"" << name << "\", \"pieces\": " << pieces
+            << ", \"length\": " << length
+            << ", \"ms\": " << seconds * 1e3
+            << ", \"ns_per_byte\": " << seconds * 1e9 / length
+            << ", \"allocated_per_byte\": " << allocatedPerByte << "}";
+        return allocatedPerByte <= MAX_ALLOCATED_PER_BYTE;
+    }
+
+int main(int argc, char* argv[])
+{
+    std::ios_base::sync_with_stdio(0);
+    bool isQuick = (argc == 2 && std::string(argv[1]) == "--quick");
+    if (argc > 2 || (argc == 2 && !isQuick))
+    {
+        std::cerr << "Usage: bench [--quick]" << std::endl;
+        return -1;
+    }
+    const size_t* counts = isQuick ? QUICK_PIECE_COUNTS : PIECE_COUNTS;
+    size_t countCount = isQuick ? sizeof(QUICK_PIECE_COUNTS) / sizeof(QUICK_PIECE_COUNTS[0])
+                                : sizeof(PIECE_COUNTS) / sizeof(PIECE_COUNTS[0]);
+
+    std::cout << "{\n  \"benchmark\": \"lazy_string\",\n  \"alternating_append\": [\n";
+    bool isFirst = true;
+    bool isLinear = true;
+    for (size_t i = 0; i != countCount; ++i)
+    {
+        isLinear = runAlternating<std_utils::lazy_string>("lazy_string", counts[i], isFirst) && isLinear;
+        runAlternating<std::string>("std::string", counts[i], isFirst);
+    }
+    std::cout << "\n  ]\n}" << std::endl;
+
+    if (!isLinear)
+    {
+        std::cerr << "lazy_string: alternating appends allocated more than "
+                  << MAX_ALLOCATED_PER_BYTE << " bytes per result byte" << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -1,13 +1,107 @@
 #ifndef LAZY_STRING_HPP
 #define LAZY_STRING_HPP
 
-#include <memory>
+#include <atomic>
+#include <new>
 #include <string>
-#include <cctype>
+#ifdef __SSE2__
+#include <immintrin.h>
+#endif
+#include <algorithm>
+#include <stdexcept>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 namespace std_utils
 {
 
+    namespace details
+    {
+        // Uppercases the ASCII letters among 8 bytes at once; other bytes are left alone.
+        inline uint64_t fold_case_word(uint64_t word)
+        {
+            const uint64_t high_bits = 0x8080808080808080ull;
+            uint64_t low_bits = word & ~high_bits;
+            uint64_t from_a = low_bits + 0x1F1F1F1F1F1F1F1Full;
+            uint64_t past_z = low_bits + 0x0505050505050505ull;
+            uint64_t lower = from_a & ~past_z & ~word & high_bits;
+            return word ^ (lower >> 2);
+        }
+
+        inline uint64_t multiply_mix(uint64_t first, uint64_t second)
+        {
+#ifdef __SIZEOF_INT128__
+            __extension__ typedef unsigned __int128 uint128;
+            uint128 product = static_cast<uint128>(first) * second;
+            return static_cast<uint64_t>(product) ^ static_cast<uint64_t>(product >> 64);
+#else
+            uint64_t first_high = first >> 32, first_low = static_cast<uint32_t>(first);
+            uint64_t second_high = second >> 32, second_low = static_cast<uint32_t>(second);
+            uint64_t low = first_low * second_low;
+            uint64_t middle = first_high * second_low + (low >> 32);
+            uint64_t middle_low = static_cast<uint32_t>(middle) + first_low * second_high;
+            uint64_t high = first_high * second_high + (middle >> 32) + (middle_low >> 32);
+            return high ^ ((middle_low << 32) | static_cast<uint32_t>(low));
+#endif
+        }
+
+        template<bool Fold>
+        inline uint64_t load_word(const unsigned char* bytes, size_t count)
+        {
+            uint64_t word = 0;
+            std::memcpy(&word, bytes, count);
+            return Fold ? fold_case_word(word) : word;
+        }
+
+        // A wyhash-style multiply-mix over 16-byte steps; Fold hashes ASCII case-insensitively.
+        template<bool Fold>
+        inline uint64_t hash_bytes(const void* data, size_t size)
+        {
+            const uint64_t prime_0 = 0xa0761d6478bd642full, prime_1 = 0xe7037ed1a0b428dbull;
+            const unsigned char* bytes = static_cast<const unsigned char*>(data);
+            uint64_t seed = prime_0 ^ size;
+
+            for (; size > 16; bytes += 16, size -= 16)
+            {
+                seed = multiply_mix(load_word<Fold>(bytes, 8) ^ prime_1, load_word<Fold>(bytes + 8, 8) ^ seed);
+            }
+
+            uint64_t first = 0, second = 0;
+            if (size >= 8)
+            {
+                first = load_word<Fold>(bytes, 8);
+                second = load_word<Fold>(bytes + size - 8, 8);
+            }
+            else if (size >= 4)
+            {
+                first = load_word<Fold>(bytes, 4);
+                second = load_word<Fold>(bytes + size - 4, 4);
+            }
+            else if (size > 0)
+            {
+                first = load_word<Fold>(bytes, 1) << 16 | load_word<Fold>(bytes + size / 2, 1) << 8 | load_word<Fold>(bytes + size - 1, 1);
+            }
+
+            return multiply_mix(prime_1 ^ size, multiply_mix(first ^ prime_1, second ^ seed));
+        }
+
+        // Hashes the characters the way `traits` compares them; see CaseIndependentCharTraits.
+        template<class traits>
+        struct string_hash
+        {
+            template<class charT>
+            static size_t hash(const charT* string, size_t length)
+            {
+                return static_cast<size_t>(hash_bytes<false>(string, length * sizeof(charT)));
+            }
+        };
+    }
+
     template<class charT, class traits = std::char_traits<charT> >
     class lazy_basic_string
     {
@@ -19,34 +113,65 @@ namespace std_utils
         typedef const value_type* const_pointer;
 
     public:
+        static const size_t npos = static_cast<size_t>(-1);
+
         lazy_basic_string()
-            : m_buffer(std::make_shared<CommonString>(0)) { }
+            : m_buffer(nullptr)
+            , m_small_length(0)
+        {
+            traits::assign(m_small[0], charT());
+        }
 
         lazy_basic_string(const lazy_basic_string& other)
-            : m_buffer(other.m_buffer) { }
+            : m_buffer(other.m_buffer)
+            , m_small_length(other.m_small_length)
+        {
+            if (m_buffer)
+            {
+                m_buffer->add_ref();
+            }
+            else
+            {
+                traits::copy(m_small, other.m_small, m_small_length + 1);
+            }
+        }
 
-        lazy_basic_string(const charT* c_str)
-            : m_buffer(std::make_shared<CommonString>(traits::length(c_str)))
+        lazy_basic_string(lazy_basic_string&& other) noexcept
+            : m_buffer(other.m_buffer)
+            , m_small_length(other.m_small_length)
         {
-            if (m_buffer->m_length > 0)
+            if (!m_buffer)
             {
-                traits::copy(m_buffer->m_string, c_str, m_buffer->m_length);
+                traits::copy(m_small, other.m_small, m_small_length + 1);
             }
+            other.m_buffer = nullptr;
+            other.m_small_length = 0;
+            traits::assign(other.m_small[0], charT());
+        }
+
+        lazy_basic_string(const charT* c_str)
+            : m_buffer(nullptr)
+        {
+            size_t length = traits::length(c_str);
+            traits::copy(allocate(length), c_str, length);
         }
 
         lazy_basic_string(charT current_char)
-            : m_buffer(std::make_shared<CommonString>(1))
+            : m_buffer(nullptr)
         {
-            traits::assign(m_buffer->m_string, 1, current_char);
+            traits::assign(allocate(1), 1, current_char);
         }
 
         lazy_basic_string(size_t size, charT current_char)
-            : m_buffer(std::make_shared<CommonString>(size))
+            : m_buffer(nullptr)
         {
-            traits::assign(m_buffer->m_string, size, current_char);
+            traits::assign(allocate(size), size, current_char);
         }
 
-        ~lazy_basic_string() { }
+        ~lazy_basic_string()
+        {
+            release_buffer();
+        }
 
         lazy_basic_string& operator=(lazy_basic_string other)
         {
@@ -56,23 +181,95 @@ namespace std_utils
 
         lazy_basic_string& operator+=(const lazy_basic_string& other)
         {
-            size_t other_size = other.m_buffer->m_length;
+            return append(other);
+        }
+
+        lazy_basic_string& operator+=(const charT* c_str)
+        {
+            return append(c_str, traits::length(c_str));
+        }
 
-            if (other_size > 0)
+        lazy_basic_string& operator+=(charT current_char)
+        {
+            return append(&current_char, 1);
+        }
+
+        // Appends in place while the buffer is unshared and has room, otherwise moves to one
+        // of at least twice the capacity, so appending in a loop is amortized linear.
+        // `string` may point into this string.
+        lazy_basic_string& append(const charT* string, size_t length)
+        {
+            size_t size = this->size();
+
+            if (length == 0)
             {
-                std::shared_ptr<CommonString> new_buffer = std::make_shared<CommonString>(m_buffer->m_length + other_size);
-                if (m_buffer->m_length > 0)
-                {
-                    traits::copy(new_buffer->m_string, m_buffer->m_string, m_buffer->m_length);
-                }
+                return *this;
+            }
 
-                traits::copy(new_buffer->m_string + m_buffer->m_length, other.m_buffer->m_string, other_size);
-                m_buffer = new_buffer;
+            if (writable() && length <= capacity() - size)
+            {
+                charT* data = m_buffer ? m_buffer->string() : m_small;
+                traits::move(data + size, string, length);
+                set_size(size + length);
+                return *this;
             }
 
+            // A flat buffer we only just stopped sharing gets no slack, one we keep appending to
+            // does. So does a rope or slice being flattened: appends alternating long pieces
+            // (roped) with short ones (flattening) must still grow geometrically.
+            size_t new_capacity = size + length;
+            if (writable())
+            {
+                new_capacity = std::max(new_capacity, 2 * capacity());
+            }
+            else if (!m_buffer->flat())
+            {
+                new_capacity = std::max(new_capacity, 2 * size);
+            }
+            CommonString* buffer = CommonString::create(size + length, new_capacity);
+            copy_to(buffer->string());
+            traits::copy(buffer->string() + size, string, length);
+            release_buffer();
+            m_buffer = buffer;
             return *this;
         }
 
+        // A long piece that would need a copy anyway becomes a rope node referring to both
+        // buffers, so assembling a document from shared pieces costs O(pieces), not O(bytes).
+        // Short pieces are always copied, so appending them one by one never builds a deep rope.
+        lazy_basic_string& append(const lazy_basic_string& other)
+        {
+            size_t size = this->size();
+            size_t other_size = other.size();
+
+            if (size == 0 && !m_buffer)
+            {
+                return *this = other;
+            }
+
+            bool in_place = writable() && other_size <= capacity() - size;
+            if (!in_place && other_size >= ROPE_MIN_LENGTH)
+            {
+                CommonString* second = other.share_buffer();
+                CommonString* first = share_buffer();
+                release_buffer();
+                m_buffer = CommonString::concatenate(first, second);
+                return *this;
+            }
+
+            return append(other.c_str(), other_size);
+        }
+
+        lazy_basic_string& append(const charT* c_str)
+        {
+            return append(c_str, traits::length(c_str));
+        }
+
+        lazy_basic_string& append(charT current_char)
+        {
+            return append(&current_char, 1);
+        }
+
     private: class Proxy;
 
     public:
@@ -83,27 +280,246 @@ namespace std_utils
 
         charT operator[](size_t index) const
         {
-            return m_buffer->m_string[index];
+            return data()[index];
         }
 
         void swap(lazy_basic_string& other)
         {
             std::swap(m_buffer, other.m_buffer);
+            std::swap(m_small_length, other.m_small_length);
+            std::swap_ranges(m_small, m_small + SMALL_CAPACITY + 1, other.m_small);
         }
 
         size_t size() const noexcept
         {
-            return m_buffer->m_length;
+            return m_buffer ? m_buffer->m_length : m_small_length;
         }
 
-        const charT* c_str() const noexcept
+        // May allocate: a rope or an inner slice is flattened the first time it is asked for.
+        const charT* c_str() const
         {
-            return m_buffer->m_string;
+            return m_buffer ? m_buffer->flat_string() : m_small;
+        }
+
+        // Unlike c_str(), never copies a substring just to terminate it.
+        const charT* data() const
+        {
+            return m_buffer ? m_buffer->data() : m_small;
         }
 
         bool empty() const noexcept
         {
-            return (m_buffer->m_length == 0);
+            return (size() == 0);
+        }
+
+        // Same sign convention as traits::compare; shorter strings order first on a common prefix.
+        int compare(const charT* string, size_t length) const
+        {
+            size_t size = this->size();
+            int cmp = traits::compare(data(), string, std::min(size, length));
+            if (cmp)
+            {
+                return cmp;
+            }
+            return (size < length) ? -1 : (size > length) ? 1 : 0;
+        }
+
+        int compare(const lazy_basic_string& other) const
+        {
+            if (m_buffer && m_buffer == other.m_buffer)
+            {
+                return 0;
+            }
+            return compare(other.data(), other.size());
+        }
+
+        int compare(const charT* c_str) const
+        {
+            return compare(c_str, traits::length(c_str));
+        }
+
+        size_t find(const charT* string, size_t pos, size_t length) const
+        {
+            size_t size = this->size();
+            if (pos > size || length > size - pos)
+            {
+                return npos;
+            }
+            if (length == 0)
+            {
+                return pos;
+            }
+
+            const charT* data = this->data();
+            const charT* last = data + size - length;
+            for (const charT* current = data + pos; current <= last; ++current)
+            {
+                current = traits::find(current, last - current + 1, string[0]);
+                if (!current)
+                {
+                    break;
+                }
+                if (traits::compare(current + 1, string + 1, length - 1) == 0)
+                {
+                    return current - data;
+                }
+            }
+            return npos;
+        }
+
+        size_t find(const lazy_basic_string& other, size_t pos = 0) const
+        {
+            return find(other.data(), pos, other.size());
+        }
+
+        size_t find(const charT* c_str, size_t pos = 0) const
+        {
+            return find(c_str, pos, traits::length(c_str));
+        }
+
+        size_t find(charT current_char, size_t pos = 0) const
+        {
+            size_t size = this->size();
+            if (pos >= size)
+            {
+                return npos;
+            }
+
+            const charT* found = traits::find(data() + pos, size - pos, current_char);
+            return found ? found - data() : npos;
+        }
+
+        size_t rfind(const charT* string, size_t pos, size_t length) const
+        {
+            size_t size = this->size();
+            if (length > size)
+            {
+                return npos;
+            }
+
+            const charT* data = this->data();
+            for (size_t index = std::min(pos, size - length) + 1; index-- > 0; )
+            {
+                if (traits::compare(data + index, string, length) == 0)
+                {
+                    return index;
+                }
+            }
+            return npos;
+        }
+
+        size_t rfind(const lazy_basic_string& other, size_t pos = npos) const
+        {
+            return rfind(other.data(), pos, other.size());
+        }
+
+        size_t rfind(const charT* c_str, size_t pos = npos) const
+        {
+            return rfind(c_str, pos, traits::length(c_str));
+        }
+
+        size_t rfind(charT current_char, size_t pos = npos) const
+        {
+            return rfind(&current_char, pos, 1);
+        }
+
+        size_t find_first_of(const charT* set, size_t pos, size_t count) const
+        {
+            size_t size = this->size();
+            const charT* data = this->data();
+            for (size_t index = pos; index < size; ++index)
+            {
+                if (traits::find(set, count, data[index]))
+                {
+                    return index;
+                }
+            }
+            return npos;
+        }
+
+        size_t find_first_of(const lazy_basic_string& set, size_t pos = 0) const
+        {
+            return find_first_of(set.data(), pos, set.size());
+        }
+
+        size_t find_first_of(const charT* set, size_t pos = 0) const
+        {
+            return find_first_of(set, pos, traits::length(set));
+        }
+
+        size_t find_first_of(charT current_char, size_t pos = 0) const
+        {
+            return find(current_char, pos);
+        }
+
+        // Refers to the characters where they are instead of copying them; a write to either
+        // string detaches it as usual. Short results are copied inline, which allocates nothing.
+        lazy_basic_string substr(size_t pos = 0, size_t count = npos) const
+        {
+            size_t size = this->size();
+            if (pos > size)
+            {
+                throw std::out_of_range("lazy_basic_string::substr");
+            }
+
+            size_t length = std::min(count, size - pos);
+            if (length == size)
+            {
+                return *this;
+            }
+
+            lazy_basic_string result;
+            if (length <= SMALL_CAPACITY)
+            {
+                traits::copy(result.allocate(length), data() + pos, length);
+            }
+            else
+            {
+                result.m_buffer = CommonString::slice(m_buffer, pos, length);
+            }
+            return result;
+        }
+
+        // Returns an identical string that shares one canonical buffer with every other interned
+        // copy of the value, so they compare by pointer and are stored once. The pool keeps
+        // only weak references: the value leaves it with its last string. Short strings are
+        // inline and are returned as they are.
+        lazy_basic_string intern() const
+        {
+            if (!m_buffer || m_buffer->m_interned.load(std::memory_order_relaxed))
+            {
+                return *this;
+            }
+            return InternPool::instance().intern(*this);
+        }
+
+        // Cached in a heap buffer once computed, so hashing a shared key again is a load.
+        size_t hash() const
+        {
+            return m_buffer ? m_buffer->hash() : details::string_hash<traits>::hash(m_small, m_small_length);
+        }
+
+        size_t capacity() const noexcept
+        {
+            return m_buffer ? m_buffer->m_capacity : SMALL_CAPACITY;
+        }
+
+        // Also gives this string a buffer of its own, as a write would.
+        void reserve(size_t new_capacity)
+        {
+            if (new_capacity > capacity() || !writable())
+            {
+                reallocate(std::max(new_capacity, size()));
+            }
+        }
+
+        // A shared buffer is left alone: shrinking it would only trade the slack for a copy.
+        void shrink_to_fit()
+        {
+            if (m_buffer && writable() && m_buffer->m_capacity > m_buffer->m_length)
+            {
+                reallocate(m_buffer->m_length);
+            }
         }
 
         void clear()
@@ -113,73 +529,542 @@ namespace std_utils
         }
 
     private:
+        class Composite;
+        class Concatenation;
+        class Slice;
+
+        // Thread safety is that of std::string: any number of threads may read one string, and
+        // distinct strings may be used freely even while they share a buffer. It rests on the
+        // buffer's reference count alone:
+        //  - a copy adds a reference relaxed, as its source already holds one;
+        //  - dropping one is acq_rel, so the last owner sees every other owner's reads;
+        //  - a writer detaches unless an acquire load shows it as the only owner, which orders
+        //    its write after the reads of owners that have left. No one gains a reference except
+        //    through an owner or through the intern pool, whose buffers are never written;
+        //  - what readers fill in later (a rope's flat copy, the hash) is atomic and can only
+        //    ever be set to its one correct value.
+        //
+        // Header of a heap string. A flat one is followed by its characters in the same
+        // allocation. A Concatenation (rope node) refers to two other buffers and a Slice to
+        // part of one; those are flattened into a cached flat copy when c_str() needs one.
         class CommonString
         {
         public:
-            CommonString(size_t length)
-                : m_length(length)
+            static CommonString* create(size_t length, size_t capacity)
+            {
+                void* memory = ::operator new(sizeof(CommonString) + (capacity + 1) * sizeof(charT));
+                CommonString* buffer = new (memory) CommonString(length, capacity);
+                traits::assign(buffer->string()[length], charT());
+                return buffer;
+            }
+
+            // Takes over one reference to each piece.
+            static CommonString* concatenate(CommonString* first, CommonString* second)
             {
-                m_string = new charT[m_length + 1];
-                traits::assign(m_string + m_length, 1, charT());
+                return new Concatenation(first, second);
             }
 
-            CommonString(const CommonString & other)
-                : m_length(other.m_length)
+            // A slice of a slice refers straight to the underlying buffer.
+            static CommonString* slice(CommonString* base, size_t offset, size_t length)
             {
-                m_string = new charT[m_length + 1];
-                traits::assign(m_string + m_length, 1, charT());
+                if (base->m_kind == SLICE)
+                {
+                    const Slice* outer = static_cast<const Slice*>(base);
+                    offset += outer->m_offset;
+                    base = outer->m_base;
+                }
+
+                base->add_ref();
+                return new Slice(base, offset, length);
             }
 
-            CommonString(CommonString && other)
-                : m_string(other.m_string)
-                , m_length(other.m_length)
+            void add_ref() noexcept
             {
-                    other.m_length = 0;
-                    other.m_string = new charT[1];
-                    traits::assign(other.m_string, 1, charT());
+                m_references.fetch_add(1, std::memory_order_relaxed);
             }
 
-            void swap(CommonString& other)
+            // The last owner frees the buffer; acq_rel orders every owner's reads before that.
+            // A rope may be arbitrarily deep on either side, so it is torn down without recursion:
+            // a dead node whose second piece is still to be released is kept on a stack linked
+            // through its own m_first, which has already been walked.
+            void release() noexcept
             {
-                std::swap(m_string, other.m_string);
-                std::swap(m_length, other.m_length);
+                Concatenation* pending = nullptr;
+                CommonString* buffer = this;
+                for (;;)
+                {
+                    if (buffer->m_references.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                    {
+                        if (buffer->m_kind == SLICE)
+                        {
+                            Slice* slice = static_cast<Slice*>(buffer);
+                            buffer = slice->m_base;
+                            delete slice;
+                            continue;
+                        }
+
+                        if (buffer->m_kind == CONCATENATION)
+                        {
+                            Concatenation* node = static_cast<Concatenation*>(buffer);
+                            buffer = node->m_first;
+                            node->m_first = pending;
+                            pending = node;
+                            continue;
+                        }
+
+                        if (buffer->m_interned.load(std::memory_order_relaxed))
+                        {
+                            InternPool::instance().forget(buffer);
+                        }
+                        buffer->~CommonString();
+                        ::operator delete(buffer);
+                    }
+
+                    if (!pending)
+                    {
+                        return;
+                    }
+
+                    Concatenation* node = pending;
+                    pending = static_cast<Concatenation*>(node->m_first);
+                    buffer = node->m_second;
+                    delete node;
+                }
             }
 
-            CommonString& operator=(CommonString other)
+            bool flat() const noexcept
             {
-                swap(other);
-                return *this;
+                return m_kind == FLAT;
+            }
+
+            // For weak references: fails once the last owner has let go.
+            bool try_add_ref() noexcept
+            {
+                size_t references = m_references.load(std::memory_order_relaxed);
+                while (references != 0)
+                {
+                    if (m_references.compare_exchange_weak(references, references + 1, std::memory_order_relaxed))
+                    {
+                        return true;
+                    }
+                }
+                return false;
+            }
+
+            // A single load: an owner that sees itself alone may write in place.
+            bool shared() const noexcept
+            {
+                return m_references.load(std::memory_order_acquire) != 1;
+            }
+
+            // Flat buffers only.
+            charT* string() noexcept
+            {
+                return reinterpret_cast<charT*>(this + 1);
+            }
+
+            const charT* string() const noexcept
+            {
+                return reinterpret_cast<const charT*>(this + 1);
+            }
+
+            // The first m_length characters, not necessarily terminated.
+            const charT* data() const
+            {
+                if (m_kind == FLAT)
+                {
+                    return string();
+                }
+                if (m_kind == SLICE)
+                {
+                    const Slice* slice = static_cast<const Slice*>(this);
+                    return slice->m_base->data() + slice->m_offset;
+                }
+                return static_cast<const Composite*>(this)->flatten()->string();
+            }
+
+            // The characters followed by a terminator; a suffix slice already is.
+            const charT* flat_string() const
+            {
+                if (m_kind == SLICE)
+                {
+                    const Slice* slice = static_cast<const Slice*>(this);
+                    if (slice->m_offset + m_length == slice->m_base->m_length)
+                    {
+                        return data();
+                    }
+                }
+                return flat() ? string() : static_cast<const Composite*>(this)->flatten()->string();
             }
 
-            CommonString& operator=(CommonString&& other)
+            // 0 stands for not computed yet; a string that really hashes to 0 is just rehashed.
+            size_t hash() const
             {
-                delete [] m_string;
-                m_length = other.m_length;
-                other.m_length = 0;
-                m_string = other.m_string;
-                other.m_string = new charT[1];
-                traits::assign(other.m_string, 1, charT());
+                size_t hash = m_hash.load(std::memory_order_relaxed);
+                if (!hash)
+                {
+                    hash = details::string_hash<traits>::hash(data(), m_length);
+                    m_hash.store(hash, std::memory_order_relaxed);
+                }
+                return hash;
             }
 
-            ~CommonString()
+            // Writes the m_length characters to `out`, reusing any flat copy already made.
+            // Walks the left spine in a loop; second pieces that are unflattened ropes themselves
+            // wait on an explicit stack, so a rope of any shape is copied without recursion.
+            void copy_to(charT* out) const
             {
-                delete [] m_string;
+                std::vector<std::pair<const CommonString*, charT*>> pending;
+                const CommonString* buffer = this;
+                for (;;)
+                {
+                    while (buffer->m_kind == CONCATENATION)
+                    {
+                        const Concatenation* node = static_cast<const Concatenation*>(buffer);
+                        if (const CommonString* cached = node->m_flat.load(std::memory_order_acquire))
+                        {
+                            buffer = cached;
+                            break;
+                        }
+
+                        const CommonString* second = node->m_second;
+                        charT* second_out = out + node->m_first->m_length;
+                        if (second->m_kind == CONCATENATION)
+                        {
+                            pending.emplace_back(second, second_out);
+                        }
+                        else
+                        {
+                            traits::copy(second_out, second->data(), second->m_length);
+                        }
+                        buffer = node->m_first;
+                    }
+
+                    traits::copy(out, buffer->data(), buffer->m_length);
+                    if (pending.empty())
+                    {
+                        return;
+                    }
+
+                    buffer = pending.back().first;
+                    out = pending.back().second;
+                    pending.pop_back();
+                }
             }
 
         private:
-            charT* m_string;
+            enum Kind { FLAT, CONCATENATION, SLICE };
+
+            std::atomic<size_t> m_references;
             size_t m_length;
+            size_t m_capacity;
+            Kind m_kind;
+            mutable std::atomic<size_t> m_hash;
+            // Set once, while the buffer is being published in the pool; it is never written after.
+            std::atomic<bool> m_interned;
+
+            CommonString(size_t length, size_t capacity, Kind kind = FLAT)
+                : m_references(1)
+                , m_length(length)
+                , m_capacity(capacity)
+                , m_kind(kind)
+                , m_hash(0)
+                , m_interned(false) { }
+
+            CommonString(const CommonString&) = delete;
+            CommonString& operator=(const CommonString&) = delete;
 
             friend class lazy_basic_string<charT, traits>;
         };
 
-        std::shared_ptr<CommonString> m_buffer;
+        // A buffer without characters of its own; a flat copy is made when one is needed.
+        class Composite : public CommonString
+        {
+        public:
+            ~Composite()
+            {
+                if (CommonString* cached = m_flat.load(std::memory_order_acquire))
+                {
+                    cached->release();
+                }
+            }
+
+            // Readers racing to flatten the same node each build a copy; the first published wins.
+            const CommonString* flatten() const
+            {
+                CommonString* cached = m_flat.load(std::memory_order_acquire);
+                if (!cached)
+                {
+                    CommonString* mine = CommonString::create(this->m_length, this->m_length);
+                    this->copy_to(mine->string());
+                    if (m_flat.compare_exchange_strong(cached, mine, std::memory_order_acq_rel, std::memory_order_acquire))
+                    {
+                        cached = mine;
+                    }
+                    else
+                    {
+                        mine->release();
+                    }
+                }
+                return cached;
+            }
+
+        protected:
+            Composite(size_t length, typename CommonString::Kind kind)
+                : CommonString(length, length, kind)
+                , m_flat(nullptr) { }
+
+        private:
+            mutable std::atomic<CommonString*> m_flat;
+
+            friend class CommonString;
+        };
+
+        class Concatenation : public Composite
+        {
+        public:
+            Concatenation(CommonString* first, CommonString* second)
+                : Composite(first->m_length + second->m_length, CommonString::CONCATENATION)
+                , m_first(first)
+                , m_second(second) { }
+
+        private:
+            CommonString* m_first;
+            CommonString* m_second;
+
+            friend class CommonString;
+        };
+
+        class Slice : public Composite
+        {
+        public:
+            Slice(CommonString* base, size_t offset, size_t length)
+                : Composite(length, CommonString::SLICE)
+                , m_base(base)
+                , m_offset(offset) { }
+
+        private:
+            CommonString* m_base;
+            size_t m_offset;
+
+            friend class CommonString;
+        };
+
+        // Interned buffers of this string type, keyed by their exact characters and split into
+        // independently locked shards. Not by what the traits call equal: interning a
+        // case-insensitive string must not hand back another one's case. A buffer whose count
+        // drops to zero removes itself under the shard lock, and lookups only take buffers whose
+        // count they can still raise, so neither side sees a freed buffer.
+        class InternPool
+        {
+        public:
+            // Never destroyed, so strings released during static destruction still find it.
+            static InternPool& instance()
+            {
+                static InternPool* pool = new InternPool();
+                return *pool;
+            }
+
+            lazy_basic_string intern(const lazy_basic_string& string)
+            {
+                size_t hash = exact_hash(string.data(), string.size());
+                Shard& shard = m_shards[shard_index(hash)];
+                lazy_basic_string result;
+
+                std::lock_guard<std::mutex> lock(shard.m_lock);
+                typedef typename std::unordered_multimap<size_t, CommonString*>::iterator iterator;
+                std::pair<iterator, iterator> candidates = shard.m_buffers.equal_range(hash);
+                for (iterator candidate = candidates.first; candidate != candidates.second; ++candidate)
+                {
+                    CommonString* buffer = candidate->second;
+                    if (buffer->m_length == string.size() && std::char_traits<charT>::compare(buffer->string(), string.data(), buffer->m_length) == 0 && buffer->try_add_ref())
+                    {
+                        result.m_buffer = buffer;
+                        return result;
+                    }
+                }
+
+                // Ropes and slices are interned as a flat copy of just their characters.
+                result.m_buffer = string.m_buffer->flat() ? string.share_buffer() : string.flat_copy();
+                result.m_buffer->m_interned.store(true, std::memory_order_relaxed);
+                shard.m_buffers.insert(std::make_pair(hash, result.m_buffer));
+                return result;
+            }
+
+            void forget(CommonString* buffer)
+            {
+                size_t hash = exact_hash(buffer->string(), buffer->m_length);
+                Shard& shard = m_shards[shard_index(hash)];
+
+                std::lock_guard<std::mutex> lock(shard.m_lock);
+                typedef typename std::unordered_multimap<size_t, CommonString*>::iterator iterator;
+                std::pair<iterator, iterator> candidates = shard.m_buffers.equal_range(hash);
+                for (iterator candidate = candidates.first; candidate != candidates.second; ++candidate)
+                {
+                    if (candidate->second == buffer)
+                    {
+                        shard.m_buffers.erase(candidate);
+                        return;
+                    }
+                }
+            }
+
+        private:
+            static const size_t SHARD_COUNT = 16;
+
+            struct Shard
+            {
+                std::mutex m_lock;
+                std::unordered_multimap<size_t, CommonString*> m_buffers;
+            };
+
+            Shard m_shards[SHARD_COUNT];
+
+            static size_t exact_hash(const charT* string, size_t length)
+            {
+                return static_cast<size_t>(details::hash_bytes<false>(string, length * sizeof(charT)));
+            }
+
+            // The map buckets use the low bits, so shards are picked by the high ones.
+            static size_t shard_index(size_t hash)
+            {
+                return (hash >> (sizeof(size_t) * 8 - 4)) % SHARD_COUNT;
+            }
+        };
+
+        // Strings of up to SMALL_CAPACITY characters live in m_small and are copied eagerly;
+        // longer ones are shared through m_buffer until written to.
+        static const size_t SMALL_CAPACITY = (16 / sizeof(charT) > 1) ? 16 / sizeof(charT) - 1 : 1;
+        // Shorter appended pieces are copied: a rope node would cost as much as their bytes.
+        static const size_t ROPE_MIN_LENGTH = 128;
+
+        CommonString* m_buffer;
+        size_t m_small_length;
+        charT m_small[SMALL_CAPACITY + 1];
+
+        // Makes this string an unshared, uninitialized one of `length` characters and returns them.
+        charT* allocate(size_t length)
+        {
+            release_buffer();
+
+            if (length <= SMALL_CAPACITY)
+            {
+                m_small_length = length;
+                traits::assign(m_small[length], charT());
+                return m_small;
+            }
+
+            m_buffer = CommonString::create(length, length);
+            m_small_length = 0;
+            return m_buffer->string();
+        }
+
+        // Moves the characters to an unshared buffer with room for `new_capacity` of them,
+        // back inline if they fit there.
+        void reallocate(size_t new_capacity)
+        {
+            size_t size = this->size();
+
+            if (new_capacity <= SMALL_CAPACITY)
+            {
+                if (m_buffer)
+                {
+                    CommonString* buffer = m_buffer;
+                    m_buffer = nullptr;
+                    buffer->copy_to(m_small);
+                    buffer->release();
+                    set_size(size);
+                }
+                return;
+            }
+
+            CommonString* buffer = CommonString::create(size, new_capacity);
+            copy_to(buffer->string());
+            release_buffer();
+            m_buffer = buffer;
+        }
+
+        // Only an unshared flat buffer, or the inline one, may be written in place.
+        // Interned buffers are canonical values and are never written, even by a sole owner.
+        bool writable() const noexcept
+        {
+            return !m_buffer || (m_buffer->flat() && !m_buffer->shared() && !m_buffer->m_interned.load(std::memory_order_relaxed));
+        }
+
+        void copy_to(charT* out) const
+        {
+            if (m_buffer)
+            {
+                m_buffer->copy_to(out);
+            }
+            else
+            {
+                traits::copy(out, m_small, m_small_length);
+            }
+        }
+
+        // An unshared flat heap buffer holding exactly this string's characters.
+        CommonString* flat_copy() const
+        {
+            size_t size = this->size();
+            CommonString* buffer = CommonString::create(size, size);
+            copy_to(buffer->string());
+            return buffer;
+        }
+
+        // A new reference to this string's characters as a heap buffer.
+        CommonString* share_buffer() const
+        {
+            if (m_buffer)
+            {
+                m_buffer->add_ref();
+                return m_buffer;
+            }
+            return flat_copy();
+        }
+
+        void set_size(size_t size) noexcept
+        {
+            if (m_buffer)
+            {
+                m_buffer->m_length = size;
+                m_buffer->m_hash.store(0, std::memory_order_relaxed);
+                traits::assign(m_buffer->string()[size], charT());
+            }
+            else
+            {
+                m_small_length = size;
+                traits::assign(m_small[size], charT());
+            }
+        }
+
+        void release_buffer() noexcept
+        {
+            if (m_buffer)
+            {
+                m_buffer->release();
+                m_buffer = nullptr;
+            }
+        }
+
+        // The caller is about to change the characters, so any cached hash goes.
+        charT* mutable_data()
+        {
+            make_unique_if_need();
+            if (m_buffer)
+            {
+                m_buffer->m_hash.store(0, std::memory_order_relaxed);
+                return m_buffer->string();
+            }
+            return m_small;
+        }
 
         void make_unique_if_need()
         {
-            if (!m_buffer.unique()) {
-                std::shared_ptr<CommonString> new_buffer = std::make_shared<CommonString>(m_buffer->m_length);
-                traits::copy(new_buffer->m_string, m_buffer->m_string, m_buffer->m_length);
+            if (!writable()) {
+                CommonString* new_buffer = CommonString::create(m_buffer->m_length, m_buffer->m_length);
+                m_buffer->copy_to(new_buffer->string());
+                m_buffer->release();
                 m_buffer = new_buffer;
             }
         }
@@ -187,18 +1072,24 @@ namespace std_utils
         class Proxy
         {
         public:
-            operator charT()
+            operator charT() const
             {
-                return str->c_str()[index];
+                return str->data()[index];
             }
 
+            // The character is read before the write may detach, so s[i] = s[j] works too.
             Proxy& operator=(const charT & ch)
             {
-                str->make_unique_if_need();
-                str->m_buffer->m_string[index] = ch;
+                str->mutable_data()[index] = ch;
                 return *this;
             }
 
+            // s[i] = t[j] writes the character; the implicit version would rebind the proxy.
+            Proxy& operator=(const Proxy& other)
+            {
+                return *this = static_cast<charT>(other);
+            }
+
         private:
             friend class lazy_basic_string;
             size_t index;
@@ -214,44 +1105,240 @@ namespace std_utils
         };
     };
 
-    struct CaseIndependentCharTraits : public std::char_traits<char>
+    // A window into a lazy string that keeps its buffer alive, so narrowing it down copies
+    // nothing and allocates nothing. Writes to the string it came from detach that string.
+    template<class charT, class traits = std::char_traits<charT> >
+    class lazy_basic_string_view
     {
-        static bool eq(char char_first, char char_second)
+    public:
+        static const size_t npos = static_cast<size_t>(-1);
+
+        lazy_basic_string_view()
+            : m_offset(0)
+            , m_length(0) { }
+
+        lazy_basic_string_view(const lazy_basic_string<charT, traits>& string)
+            : m_string(string)
+            , m_offset(0)
+            , m_length(string.size()) { }
+
+        const charT* data() const
         {
-             return std::toupper(char_first) == std::toupper(char_second);
+            return m_string.data() + m_offset;
         }
 
-        static bool lt(char char_first, char char_second)
+        size_t size() const noexcept
         {
-             return std::toupper(char_first) <  std::toupper(char_second);
+            return m_length;
         }
 
-        static int compare(const char* string_first, const char* string_second, size_t size)
+        bool empty() const noexcept
+        {
+            return (m_length == 0);
+        }
+
+        charT operator[](size_t index) const
+        {
+            return data()[index];
+        }
+
+        lazy_basic_string_view substr(size_t pos = 0, size_t count = npos) const
         {
-            while (size-- != 0)
+            if (pos > m_length)
             {
-                if (std::toupper(*string_first) < std::toupper(*string_second))
+                throw std::out_of_range("lazy_basic_string_view::substr");
+            }
+
+            lazy_basic_string_view result(*this);
+            result.m_offset += pos;
+            result.m_length = std::min(count, m_length - pos);
+            return result;
+        }
+
+        void remove_prefix(size_t count)
+        {
+            m_offset += count;
+            m_length -= count;
+        }
+
+        void remove_suffix(size_t count)
+        {
+            m_length -= count;
+        }
+
+        // A string sharing the same characters.
+        lazy_basic_string<charT, traits> str() const
+        {
+            return m_string.substr(m_offset, m_length);
+        }
+
+    private:
+        lazy_basic_string<charT, traits> m_string;
+        size_t m_offset;
+        size_t m_length;
+    };
+
+    template<class charT, class traits>
+    bool operator==(const lazy_basic_string_view<charT, traits> & first_view, const lazy_basic_string_view<charT, traits> & second_view)
+    {
+        return first_view.size() == second_view.size() && !traits::compare(first_view.data(), second_view.data(), first_view.size());
+    }
+
+    template<class charT, class traits>
+    bool operator!=(const lazy_basic_string_view<charT, traits> & first_view, const lazy_basic_string_view<charT, traits> & second_view)
+    {
+        return !(first_view == second_view);
+    }
+
+    template<class charT, class traits>
+    bool operator<(const lazy_basic_string_view<charT, traits> & first_view, const lazy_basic_string_view<charT, traits> & second_view)
+    {
+        int cmp = traits::compare(first_view.data(), second_view.data(), std::min(first_view.size(), second_view.size()));
+        return cmp ? cmp < 0 : first_view.size() < second_view.size();
+    }
+
+    namespace details
+    {
+        // Case folding is ASCII only, as std::toupper does in the "C" locale, so that the
+        // vector and scalar paths agree and nothing depends on the global locale.
+        inline unsigned char fold_case(char current_char)
+        {
+            unsigned char folded = static_cast<unsigned char>(current_char);
+            return (folded >= 'a' && folded <= 'z') ? folded - ('a' - 'A') : folded;
+        }
+
+#ifdef __SSE2__
+        inline __m128i fold_case(__m128i chars)
+        {
+            // Bytes from 0x80 up compare as negative and are never taken for letters.
+            __m128i lower = _mm_and_si128(_mm_cmpgt_epi8(chars, _mm_set1_epi8('a' - 1)),
+                                          _mm_cmplt_epi8(chars, _mm_set1_epi8('z' + 1)));
+            return _mm_sub_epi8(chars, _mm_and_si128(lower, _mm_set1_epi8('a' - 'A')));
+        }
+#endif
+
+#ifdef __AVX2__
+        inline __m256i fold_case(__m256i chars)
+        {
+            __m256i lower = _mm256_and_si256(_mm256_cmpgt_epi8(chars, _mm256_set1_epi8('a' - 1)),
+                                             _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), chars));
+            return _mm256_sub_epi8(chars, _mm256_and_si256(lower, _mm256_set1_epi8('a' - 'A')));
+        }
+#endif
+
+        // Index of the first position where the folded strings differ, or size.
+        inline size_t mismatch_case_folded(const char* first, const char* second, size_t size)
+        {
+            size_t index = 0;
+#ifdef __AVX2__
+            for (; index + 32 <= size; index += 32)
+            {
+                __m256i first_chars = fold_case(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(first + index)));
+                __m256i second_chars = fold_case(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(second + index)));
+                unsigned equal = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(first_chars, second_chars)));
+                if (equal != 0xFFFFFFFFu)
                 {
-                    return -1;
+                    return index + __builtin_ctz(~equal);
                 }
-                if (std::toupper(*string_first) > std::toupper(*string_second))
+            }
+#endif
+#ifdef __SSE2__
+            for (; index + 16 <= size; index += 16)
+            {
+                __m128i first_chars = fold_case(_mm_loadu_si128(reinterpret_cast<const __m128i*>(first + index)));
+                __m128i second_chars = fold_case(_mm_loadu_si128(reinterpret_cast<const __m128i*>(second + index)));
+                unsigned equal = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(first_chars, second_chars)));
+                if (equal != 0xFFFFu)
                 {
-                    return 1;
+                    return index + __builtin_ctz(~equal);
                 }
+            }
+#endif
+            while (index < size && fold_case(first[index]) == fold_case(second[index]))
+            {
+                ++index;
+            }
+            return index;
+        }
 
-                ++string_first; ++string_second;
+        inline const char* find_case_folded(const char* string, size_t size, char current_char)
+        {
+            size_t index = 0;
+            unsigned char folded = fold_case(current_char);
+#ifdef __AVX2__
+            __m256i wanted_wide = _mm256_set1_epi8(static_cast<char>(folded));
+            for (; index + 32 <= size; index += 32)
+            {
+                __m256i chars = fold_case(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(string + index)));
+                unsigned found = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(chars, wanted_wide)));
+                if (found)
+                {
+                    return string + index + __builtin_ctz(found);
+                }
+            }
+#endif
+#ifdef __SSE2__
+            __m128i wanted = _mm_set1_epi8(static_cast<char>(folded));
+            for (; index + 16 <= size; index += 16)
+            {
+                __m128i chars = fold_case(_mm_loadu_si128(reinterpret_cast<const __m128i*>(string + index)));
+                unsigned found = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(chars, wanted)));
+                if (found)
+                {
+                    return string + index + __builtin_ctz(found);
+                }
+            }
+#endif
+            for (; index < size; ++index)
+            {
+                if (fold_case(string[index]) == folded)
+                {
+                    return string + index;
+                }
             }
-            return 0;
+            return nullptr;
+        }
+    }
+
+    struct CaseIndependentCharTraits;
+
+    namespace details
+    {
+        template<>
+        struct string_hash<CaseIndependentCharTraits>
+        {
+            static size_t hash(const char* string, size_t length)
+            {
+                return static_cast<size_t>(hash_bytes<true>(string, length));
+            }
+        };
+    }
+
+    struct CaseIndependentCharTraits : public std::char_traits<char>
+    {
+        static bool eq(char char_first, char char_second)
+        {
+             return details::fold_case(char_first) == details::fold_case(char_second);
         }
 
-        static const char* find(const char* s, int size, char a)
+        static bool lt(char char_first, char char_second)
+        {
+             return details::fold_case(char_first) <  details::fold_case(char_second);
+        }
+
+        static int compare(const char* string_first, const char* string_second, size_t size)
         {
-            while ((size-- > 0) && (std::toupper(*s) != std::toupper(a)))
+            size_t index = details::mismatch_case_folded(string_first, string_second, size);
+            if (index == size)
             {
-                ++s;
+                return 0;
             }
+            return lt(string_first[index], string_second[index]) ? -1 : 1;
+        }
 
-            return s;
+        static const char* find(const char* s, size_t size, char a)
+        {
+            return details::find_case_folded(s, size, a);
         }
     };
 
@@ -259,6 +1346,9 @@ namespace std_utils
     typedef std_utils::lazy_basic_string<char> lazy_string;
     typedef std_utils::lazy_basic_string<wchar_t> lazy_wstring;
     typedef std_utils::lazy_basic_string<char, CaseIndependentCharTraits> lazy_istring;
+    typedef std_utils::lazy_basic_string_view<char> lazy_string_view;
+    typedef std_utils::lazy_basic_string_view<wchar_t> lazy_wstring_view;
+    typedef std_utils::lazy_basic_string_view<char, CaseIndependentCharTraits> lazy_istring_view;
 
 
     template<class charT, class traits = std::char_traits<charT> >
@@ -269,54 +1359,48 @@ namespace std_utils
         return temp;
     }
 
+    // A temporary on the left is appended to in place, so a + b + c grows one buffer.
     template<class charT, class traits = std::char_traits<charT> >
-    bool operator<(const std_utils::lazy_basic_string<charT, traits> & first_string, const std_utils::lazy_basic_string<charT, traits> & second_string)
+    std_utils::lazy_basic_string<charT, traits> operator+(std_utils::lazy_basic_string<charT, traits> && first_string, const std_utils::lazy_basic_string<charT, traits> & second_string)
     {
-        size_t first_size = first_string.size();
-        size_t second_size = second_string.size();
-        size_t min_size = std::min(first_size, second_size);
-
-        int cmp = traits::compare(first_string.c_str(), second_string.c_str(), min_size);
-        if (cmp)
-        {
-            return cmp < 0;
-        }
-        else
-        {
-            return first_size < second_size;
-        }
+        first_string += second_string;
+        return std::move(first_string);
     }
 
     template<class charT, class traits = std::char_traits<charT> >
     bool operator==(const std_utils::lazy_basic_string<charT, traits> & first_string, const std_utils::lazy_basic_string<charT, traits> & second_string)
     {
-        size_t first_size = first_string.size();
-        size_t second_size = second_string.size();
-        return !((first_size != second_size) || traits::compare(first_string.c_str(), second_string.c_str(), second_size));
+        return first_string.size() == second_string.size() && first_string.compare(second_string) == 0;
     }
 
     template<class charT, class traits = std::char_traits<charT> >
-    bool operator>(const std_utils::lazy_basic_string<charT, traits> & first_string, const std_utils::lazy_basic_string<charT, traits> & second_string)
+    bool operator!=(const std_utils::lazy_basic_string<charT, traits> & first_string, const std_utils::lazy_basic_string<charT, traits> & second_string)
     {
-        return !(first_string <= second_string);
+        return !(first_string == second_string);
     }
 
     template<class charT, class traits = std::char_traits<charT> >
-    bool operator<=(const std_utils::lazy_basic_string<charT, traits> & first_string, const std_utils::lazy_basic_string<charT, traits> & second_string)
+    bool operator<(const std_utils::lazy_basic_string<charT, traits> & first_string, const std_utils::lazy_basic_string<charT, traits> & second_string)
     {
-        return ((first_string == second_string) || (first_string < second_string));
+        return first_string.compare(second_string) < 0;
     }
 
     template<class charT, class traits = std::char_traits<charT> >
-    bool operator>=(const std_utils::lazy_basic_string<charT, traits> & first_string, const std_utils::lazy_basic_string<charT, traits> & second_string)
+    bool operator>(const std_utils::lazy_basic_string<charT, traits> & first_string, const std_utils::lazy_basic_string<charT, traits> & second_string)
     {
-        return !(first_string < second_string);
+        return first_string.compare(second_string) > 0;
     }
 
     template<class charT, class traits = std::char_traits<charT> >
-    bool operator!=(const std_utils::lazy_basic_string<charT, traits> & first_string, const std_utils::lazy_basic_string<charT, traits> & second_string)
+    bool operator<=(const std_utils::lazy_basic_string<charT, traits> & first_string, const std_utils::lazy_basic_string<charT, traits> & second_string)
     {
-        return !(first_string == second_string);
+        return first_string.compare(second_string) <= 0;
+    }
+
+    template<class charT, class traits = std::char_traits<charT> >
+    bool operator>=(const std_utils::lazy_basic_string<charT, traits> & first_string, const std_utils::lazy_basic_string<charT, traits> & second_string)
+    {
+        return first_string.compare(second_string) >= 0;
     }
 
     template<class charT, class traits = std::char_traits<charT> >
@@ -336,12 +1420,18 @@ namespace std_utils
     template<class charT, class traits = std::char_traits<charT> >
     std_utils::lazy_basic_string<charT, traits> operator+(const std_utils::lazy_basic_string<charT, traits> & first_string, const charT* second_c_string)
     {
-        std_utils::lazy_basic_string<charT, traits> second_string(second_c_string);
         std_utils::lazy_basic_string<charT, traits> temp(first_string);
-        temp += second_string;
+        temp += second_c_string;
         return temp;
     }
 
+    template<class charT, class traits = std::char_traits<charT> >
+    std_utils::lazy_basic_string<charT, traits> operator+(std_utils::lazy_basic_string<charT, traits> && first_string, const charT* second_c_string)
+    {
+        first_string += second_c_string;
+        return std::move(first_string);
+    }
+
     template<class charT, class traits = std::char_traits<charT> >
     std_utils::lazy_basic_string<charT, traits> operator+(const charT first_char_string, const std_utils::lazy_basic_string<charT, traits> & second_string)
     {
@@ -353,97 +1443,105 @@ namespace std_utils
     template<class charT, class traits = std::char_traits<charT> >
     std_utils::lazy_basic_string<charT, traits> operator+(const std_utils::lazy_basic_string<charT, traits> & first_string, const charT second_char_string)
     {
-        std_utils::lazy_basic_string<charT, traits> second_string(second_char_string);
         std_utils::lazy_basic_string<charT, traits> temp(first_string);
-        temp += second_string;
+        temp += second_char_string;
         return temp;
     }
 
+    template<class charT, class traits = std::char_traits<charT> >
+    std_utils::lazy_basic_string<charT, traits> operator+(std_utils::lazy_basic_string<charT, traits> && first_string, const charT second_char_string)
+    {
+        first_string += second_char_string;
+        return std::move(first_string);
+    }
+
     template<class charT, class traits = std::char_traits<charT> >
     bool operator==(const charT* first_c_string, const std_utils::lazy_basic_string<charT, traits> & second_string)
     {
-        std_utils::lazy_basic_string<charT, traits> first_string(first_c_string);
-        return first_string == second_string;
+        return second_string.compare(first_c_string) == 0;
     }
 
     template<class charT, class traits = std::char_traits<charT> >
-    bool operator==(const std_utils::lazy_basic_string<charT, traits> & first_string, const charT* second_c_string) {
-        std_utils::lazy_basic_string<charT, traits> second_string(second_c_string);
-        return first_string == second_string;
+    bool operator==(const std_utils::lazy_basic_string<charT, traits> & first_string, const charT* second_c_string)
+    {
+        return first_string.compare(second_c_string) == 0;
     }
 
     template<class charT, class traits = std::char_traits<charT> >
     bool operator!=(const charT* first_c_string, const std_utils::lazy_basic_string<charT, traits> & second_string)
     {
-        std_utils::lazy_basic_string<charT, traits> first_string(first_c_string);
-        return first_string != second_string;
+        return second_string.compare(first_c_string) != 0;
     }
 
     template<class charT, class traits = std::char_traits<charT> >
     bool operator!=(const std_utils::lazy_basic_string<charT, traits> & first_string, const charT* second_c_string)
     {
-        std_utils::lazy_basic_string<charT, traits> second_string(second_c_string);
-        return first_string != second_string;
+        return first_string.compare(second_c_string) != 0;
     }
 
     template<class charT, class traits = std::char_traits<charT> >
     bool operator<(const charT* first_c_string, const std_utils::lazy_basic_string<charT, traits> & second_string)
     {
-        std_utils::lazy_basic_string<charT, traits> first_string(first_c_string);
-        return first_string < second_string;
+        return second_string.compare(first_c_string) > 0;
     }
 
     template<class charT, class traits = std::char_traits<charT> >
     bool operator<(const std_utils::lazy_basic_string<charT, traits> & first_string, const charT* second_c_string)
     {
-        std_utils::lazy_basic_string<charT, traits> second_string(second_c_string);
-        return first_string < second_string;
+        return first_string.compare(second_c_string) < 0;
     }
 
     template<class charT, class traits = std::char_traits<charT> >
     bool operator>(const charT* first_c_string, const std_utils::lazy_basic_string<charT, traits> & second_string)
     {
-        std_utils::lazy_basic_string<charT, traits> first_string(first_c_string);
-        return first_string > second_string;
+        return second_string.compare(first_c_string) < 0;
     }
 
     template<class charT, class traits = std::char_traits<charT> >
     bool operator>(const std_utils::lazy_basic_string<charT, traits> & first_string, const charT* second_c_string)
     {
-        std_utils::lazy_basic_string<charT, traits> second_string(second_c_string);
-        return first_string > second_string;
+        return first_string.compare(second_c_string) > 0;
     }
 
     template<class charT, class traits = std::char_traits<charT> >
     bool operator<=(const charT* first_c_string, const std_utils::lazy_basic_string<charT, traits> & second_string)
     {
-        std_utils::lazy_basic_string<charT, traits> first_string(first_c_string);
-        return first_string <= second_string;
+        return second_string.compare(first_c_string) >= 0;
     }
 
     template<class charT, class traits = std::char_traits<charT> >
     bool operator<=(const std_utils::lazy_basic_string<charT, traits> & first_string, const charT* second_c_string)
     {
-        std_utils::lazy_basic_string<charT, traits> second_string(second_c_string);
-        return first_string <= second_string;
+        return first_string.compare(second_c_string) <= 0;
     }
 
     template<class charT, class traits = std::char_traits<charT> >
     bool operator>=(const charT* first_c_string, const std_utils::lazy_basic_string<charT, traits> & second_string)
     {
-        std_utils::lazy_basic_string<charT, traits> first_string(first_c_string);
-        return first_string >= second_string;
+        return second_string.compare(first_c_string) <= 0;
     }
 
     template<class charT, class traits = std::char_traits<charT> >
     bool operator>=(const std_utils::lazy_basic_string<charT, traits> & first_string, const charT* second_c_string)
     {
-        std_utils::lazy_basic_string<charT, traits> second_string(second_c_string);
-        return first_string >= second_string;
+        return first_string.compare(second_c_string) >= 0;
     }
 
 
 } // std_utils
 
+namespace std
+{
+    // Strings equal under their traits hash alike, so lazy_istring keys ignore ASCII case.
+    template<class charT, class traits>
+    struct hash<std_utils::lazy_basic_string<charT, traits> >
+    {
+        size_t operator()(const std_utils::lazy_basic_string<charT, traits> & string) const
+        {
+            return string.hash();
+        }
+    };
+}
+
 #endif // LAZY_STRING_HPP
 
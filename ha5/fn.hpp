@@ -1,7 +1,7 @@
 #ifndef FN_HPP
 #define FN_HPP
 
-#include <memory>
+#include <new>
 #include <type_traits>
 #include <typeinfo>
 #include <utility>
@@ -25,37 +25,42 @@ namespace fn
     {
     public:
         function()
-            : functionHolder()
+            : functionHolder(nullptr)
             , freeFunction(nullptr) {}
 
         function(std::nullptr_t)
-            : functionHolder()
+            : functionHolder(nullptr)
             , freeFunction(nullptr) {}
 
         function(const function & other)
-            : freeFunction(other.freeFunction)
+            : functionHolder(nullptr)
+            , freeFunction(other.freeFunction)
         { 
             if (freeFunction == nullptr && other.functionHolder)
             {
-                functionHolder = std::shared_ptr<BaseFunctionHolder>(other.functionHolder->clone());    
+                functionHolder = other.functionHolder->clone(&storage);
             }
         }
 
+        ~function()
+        {
+            reset();
+        }
 
         void swap(function & other)
         {
-            std::swap(freeFunction, other.freeFunction);
-            functionHolder.swap(other.functionHolder);
+            function temp(std::move(other));
+            other.reset();
+            other.moveFrom(*this);
+            reset();
+            moveFrom(temp);
         }
 
-        function(function && other)
-            : freeFunction(other.freeFunction)
+        function(function && other) noexcept
+            : functionHolder(nullptr)
+            , freeFunction(nullptr)
         {
-            if (freeFunction == nullptr && other.functionHolder)
-            {
-                functionHolder = other.functionHolder;
-                other.functionHolder.reset(static_cast<BaseFunctionHolder*>(nullptr));
-            }
+            moveFrom(other);
         }
 
         function & operator=(const function & other)
@@ -73,30 +78,23 @@ namespace fn
             if (&other == this)
                 return *this;
             
-            function new_copy(std::move(other));
-            swap(new_copy);
+            reset();
+            moveFrom(other);
             
             return *this;
         }
         
         function(RETURN_TYPE(*f)(ARG_TYPE...))
-            : freeFunction(f) { }
+            : functionHolder(nullptr)
+            , freeFunction(f) { }
 
         template<typename T>
         function(T f)
-            : functionHolder(std::make_shared<FunctionHolder<T> >(f))
+            : functionHolder(FunctionHolder<T>::create(std::move(f), &storage))
             , freeFunction(nullptr) { }
 
         explicit operator bool() const {
-            if (freeFunction != nullptr) {
-                return true;
-            }
-            else
-            {
-                return functionHolder.operator bool();
-            }
-            
-            return (freeFunction != nullptr) || functionHolder.operator bool();
+            return (freeFunction != nullptr) || (functionHolder != nullptr);
         }
 
         RETURN_TYPE operator()(ARG_TYPE && ... arg) const
@@ -116,21 +114,46 @@ namespace fn
 
 
     private:
+        // Room for a holder whose callable is up to three pointers, next to its vtable pointer.
+        using Storage = typename std::aligned_storage<4 * sizeof(void*), alignof(void*)>::type;
+
         class BaseFunctionHolder {
         public:
             virtual ~BaseFunctionHolder() {}
             virtual RETURN_TYPE operator()(ARG_TYPE && ... arg) = 0;
-            virtual BaseFunctionHolder* clone() const = 0;
+            // Copies into `storage` when the callable fits there, to the heap otherwise.
+            virtual BaseFunctionHolder* clone(void* storage) const = 0;
+            // An inline holder moves itself into `storage`; a heap one just changes owner.
+            virtual BaseFunctionHolder* moveTo(void* storage) noexcept = 0;
+            virtual void destroy() noexcept = 0;
         };
 
         template<typename FUNCTION_TYPE>
         class FunctionHolder : public BaseFunctionHolder {
         public:
             FUNCTION_TYPE function_object;
+
+            // Only callables that cannot throw while moving live inline, so moving a function never throws.
+            static const bool isInline = sizeof(FUNCTION_TYPE) <= 3 * sizeof(void*)
+                && sizeof(FunctionHolder<FUNCTION_TYPE>) <= sizeof(Storage)
+                && alignof(FunctionHolder<FUNCTION_TYPE>) <= alignof(Storage)
+                && std::is_nothrow_move_constructible<FUNCTION_TYPE>::value;
+
+            static BaseFunctionHolder* create(FUNCTION_TYPE && f, void* storage)
+            {
+                if (isInline)
+                {
+                    return new (storage) FunctionHolder(std::move(f));
+                }
+                return new FunctionHolder(std::move(f));
+            }
             
-            FunctionHolder(FUNCTION_TYPE f)
+            FunctionHolder(const FUNCTION_TYPE & f)
                 : function_object(f) {}
 
+            FunctionHolder(FUNCTION_TYPE && f)
+                : function_object(std::move(f)) {}
+
             virtual ~FunctionHolder() {}
             
             virtual RETURN_TYPE operator()(ARG_TYPE && ... arg) override
@@ -138,13 +161,63 @@ namespace fn
                 return function_object(std::forward<ARG_TYPE>(arg) ...);
             }
 
-            virtual BaseFunctionHolder* clone() const override
+            virtual BaseFunctionHolder* clone(void* storage) const override
             {
+                if (isInline)
+                {
+                    return new (storage) FunctionHolder(function_object);
+                }
                 return new FunctionHolder(function_object);
             }
+
+            virtual BaseFunctionHolder* moveTo(void* storage) noexcept override
+            {
+                if (!isInline)
+                {
+                    return this;
+                }
+                BaseFunctionHolder* moved = new (storage) FunctionHolder(std::move(function_object));
+                this->~FunctionHolder();
+                return moved;
+            }
+
+            virtual void destroy() noexcept override
+            {
+                if (isInline)
+                {
+                    this->~FunctionHolder();
+                }
+                else
+                {
+                    delete this;
+                }
+            }
         };
 
-        std::shared_ptr<BaseFunctionHolder> functionHolder;
+        // Leaves `other` empty; expects this function to be empty.
+        void moveFrom(function & other) noexcept
+        {
+            freeFunction = other.freeFunction;
+            if (other.functionHolder)
+            {
+                functionHolder = other.functionHolder->moveTo(&storage);
+                other.functionHolder = nullptr;
+            }
+            other.freeFunction = nullptr;
+        }
+
+        void reset() noexcept
+        {
+            if (functionHolder)
+            {
+                functionHolder->destroy();
+                functionHolder = nullptr;
+            }
+            freeFunction = nullptr;
+        }
+
+        Storage storage;
+        BaseFunctionHolder* functionHolder;
         using FreeFunctionType = RETURN_TYPE(*)(ARG_TYPE...);
         FreeFunctionType freeFunction;
     };